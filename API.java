@@ -6,6 +6,11 @@ import java.net.*;
 import java.nio.file.*;
 import java.util.*;
 import java.util.concurrent.Executors;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.zip.Deflater;
+import java.util.zip.GZIPOutputStream;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
 import java.text.SimpleDateFormat;
 import java.util.regex.Pattern;
 import java.util.regex.Matcher;
@@ -26,12 +31,35 @@ public class API {
     private long lastConnectionAttempt = 0;
     private static final long CONNECTION_RETRY_DELAY = 5000; // 5 seconds
     
+    // Latency tracing: every Nth command request (or any request with an
+    // X-Trace header) is traced through the C++ server, see trace.h
+    private static final int TRACE_SAMPLE_EVERY = 20;
+    private final AtomicLong traceCounter = new AtomicLong();
+    
+    // Monotonic timestamps (System.nanoTime) of one sampled request
+    static class Trace {
+        final String id;
+        final long httpReceive;
+        long bridgeEnqueue;
+        long bridgeSend;
+        long bridgeResponse;
+        
+        Trace(String id, long httpReceive) {
+            this.id = id;
+            this.httpReceive = httpReceive;
+        }
+    }
+    
     public static void main(String[] args) {
         new API().start();
     }
     
     public void start() {
         try {
+            // Static assets are served from memory
+            loadAssets();
+            watchAssets();
+            
             // Create HTTP server
             server = HttpServer.create(new InetSocketAddress(WEB_PORT), 0);
             server.setExecutor(Executors.newCachedThreadPool());
@@ -43,6 +71,8 @@ public class API {
             server.createContext("/api/command", new CommandHandler());
             server.createContext("/api/logs", new LogsHandler());
             server.createContext("/api/status", new StatusHandler());
+            server.createContext("/api/trace", new TraceHandler());
+            server.createContext("/api/query", new QueryHandler());
             
             server.start();
             System.out.println("Web server started on port " + WEB_PORT);
@@ -134,12 +164,30 @@ public class API {
         }
     }
     
-    private synchronized String sendCommandToCpp(String command) {
+    private String sendCommandToCpp(String command) {
+        return sendCommandToCpp(command, null);
+    }
+    
+    private String sendCommandToCpp(String command, Trace trace) {
+        if (trace != null) {
+            trace.bridgeEnqueue = System.nanoTime();
+        }
+        synchronized (this) {
+            return exchangeWithCpp(command, trace);
+        }
+    }
+    
+    private String exchangeWithCpp(String command, Trace trace) {
         if (!cppConnected || cppOut == null || cppIn == null) {
             return "{\"error\": \"C++ server not connected\"}";
         }
         
         try {
+            if (trace != null) {
+                trace.bridgeSend = System.nanoTime();
+                command = "@trace=" + trace.id + "," + trace.httpReceive + "," + trace.bridgeEnqueue + ","
+                        + trace.bridgeSend + " " + command;
+            }
             cppOut.println(command);
             cppOut.flush();
             
@@ -170,6 +218,9 @@ public class API {
                 cppConnected = false;
                 return "{\"error\": \"No response from C++ server\"}";
             }
+            if (trace != null) {
+                trace.bridgeResponse = System.nanoTime();
+            }
             
             String result = response.toString().trim();
             return result.isEmpty() ? "{\"error\": \"Empty response\"}" : result;
@@ -181,41 +232,235 @@ public class API {
     }
     
     // Static file handler for serving HTML/CSS/JS
+    // Static assets under WEB_ROOT, read into memory once together with a
+    // gzip copy and, when a precompressed <name>.br sits next to the file, a
+    // brotli copy (the JDK has no brotli encoder). Every representation has
+    // its own strong ETag so browsers revalidate with If-None-Match and get
+    // 304s. A watcher thread rebuilds the cache whenever web/ changes.
+    static class Asset {
+        final String contentType;
+        final byte[] identity;
+        final byte[] gzip;
+        final byte[] brotli;
+        final String etag;
+        
+        Asset(String contentType, byte[] identity, byte[] gzip, byte[] brotli, String etag) {
+            this.contentType = contentType;
+            this.identity = identity;
+            this.gzip = gzip;
+            this.brotli = brotli;
+            this.etag = etag;
+        }
+    }
+    
+    private volatile Map<String, Asset> assets = new HashMap<>();
+    
+    private void loadAssets() {
+        Map<String, Asset> loaded = new HashMap<>();
+        Path root = Paths.get(WEB_ROOT);
+        try (java.util.stream.Stream<Path> files = Files.walk(root)) {
+            for (Path file : (Iterable<Path>) files::iterator) {
+                String name = file.getFileName().toString();
+                if (!Files.isRegularFile(file) || name.endsWith(".br") || name.endsWith(".gz")) continue;
+                
+                String path = "/" + root.relativize(file).toString().replace(File.separatorChar, '/');
+                byte[] identity = Files.readAllBytes(file);
+                byte[] gzip = gzip(identity);
+                Path brFile = file.resolveSibling(name + ".br");
+                byte[] brotli = Files.isRegularFile(brFile)
+                        && Files.getLastModifiedTime(brFile).compareTo(Files.getLastModifiedTime(file)) >= 0
+                        ? Files.readAllBytes(brFile) : null;
+                loaded.put(path, new Asset(getContentType(path), identity,
+                        gzip.length < identity.length ? gzip : null, brotli, sha256Prefix(identity)));
+            }
+        } catch (IOException e) {
+            System.err.println("Failed to load web assets: " + e.getMessage());
+            return; // keep serving the previous set
+        }
+        assets = loaded;
+        System.out.println("Loaded " + loaded.size() + " web assets from " + WEB_ROOT);
+    }
+    
+    private void watchAssets() {
+        Thread watcherThread = new Thread(() -> {
+            try (WatchService watcher = FileSystems.getDefault().newWatchService()) {
+                Path root = Paths.get(WEB_ROOT);
+                registerTree(watcher, root);
+                while (true) {
+                    WatchKey key = watcher.take();
+                    // Editors write in several steps; let them settle and reload once
+                    Thread.sleep(200);
+                    registerCreatedDirectories(watcher, key, root);
+                    for (WatchKey pending; (pending = watcher.poll()) != null; ) {
+                        registerCreatedDirectories(watcher, pending, root);
+                    }
+                    loadAssets();
+                }
+            } catch (IOException e) {
+                System.err.println("Web asset watcher stopped: " + e.getMessage());
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+            }
+        });
+        watcherThread.setDaemon(true);
+        watcherThread.start();
+    }
+    
+    // Registering a directory that is already watched returns its existing key
+    private void registerTree(WatchService watcher, Path dir) throws IOException {
+        try (java.util.stream.Stream<Path> dirs = Files.walk(dir)) {
+            for (Path sub : (Iterable<Path>) dirs::iterator) {
+                if (Files.isDirectory(sub)) {
+                    sub.register(watcher, StandardWatchEventKinds.ENTRY_CREATE,
+                            StandardWatchEventKinds.ENTRY_MODIFY, StandardWatchEventKinds.ENTRY_DELETE);
+                }
+            }
+        }
+    }
+    
+    // Directories created after startup are watched too, including any
+    // subdirectories they arrived with. After an overflow the whole tree is
+    // walked again since individual events were lost.
+    private void registerCreatedDirectories(WatchService watcher, WatchKey key, Path root) throws IOException {
+        Path dir = (Path) key.watchable();
+        for (WatchEvent<?> event : key.pollEvents()) {
+            if (event.kind() == StandardWatchEventKinds.OVERFLOW) {
+                registerTree(watcher, root);
+            } else if (event.kind() == StandardWatchEventKinds.ENTRY_CREATE) {
+                Path created = dir.resolve((Path) event.context());
+                if (Files.isDirectory(created, LinkOption.NOFOLLOW_LINKS)) {
+                    try {
+                        registerTree(watcher, created);
+                    } catch (NoSuchFileException e) {
+                        // removed again before we got to it
+                    }
+                }
+            }
+        }
+        key.reset();
+    }
+    
     class StaticFileHandler implements HttpHandler {
         @Override
         public void handle(HttpExchange exchange) throws IOException {
+            String method = exchange.getRequestMethod();
+            if (!"GET".equals(method) && !"HEAD".equals(method)) {
+                sendJsonResponse(exchange, 405, "{\"error\": \"Method not allowed\"}");
+                return;
+            }
+            
             String path = exchange.getRequestURI().getPath();
             if (path.equals("/")) path = "/index.html";
             
-            File file = new File(WEB_ROOT + path);
-            
-            if (file.exists() && file.isFile()) {
-                String contentType = getContentType(path);
-                exchange.getResponseHeaders().set("Content-Type", contentType);
-                exchange.sendResponseHeaders(200, file.length());
-                
-                try (FileInputStream fis = new FileInputStream(file);
-                     OutputStream os = exchange.getResponseBody()) {
-                    byte[] buffer = new byte[8192];
-                    int bytesRead;
-                    while ((bytesRead = fis.read(buffer)) != -1) {
-                        os.write(buffer, 0, bytesRead);
-                    }
-                }
-            } else {
+            // Only cached files are served, so ../ paths never reach the disk
+            Asset asset = assets.get(path);
+            if (asset == null) {
                 String response = "404 Not Found";
                 exchange.sendResponseHeaders(404, response.length());
                 exchange.getResponseBody().write(response.getBytes());
                 exchange.getResponseBody().close();
+                return;
+            }
+            
+            String acceptEncoding = exchange.getRequestHeaders().getFirst("Accept-Encoding");
+            byte[] body = asset.identity;
+            String encoding = null;
+            if (asset.brotli != null && accepts(acceptEncoding, "br")) {
+                body = asset.brotli;
+                encoding = "br";
+            } else if (asset.gzip != null && accepts(acceptEncoding, "gzip")) {
+                body = asset.gzip;
+                encoding = "gzip";
+            }
+            String etag = "\"" + asset.etag + (encoding == null ? "" : "-" + encoding) + "\"";
+            
+            exchange.getResponseHeaders().set("Content-Type", asset.contentType);
+            exchange.getResponseHeaders().set("ETag", etag);
+            exchange.getResponseHeaders().set("Cache-Control", "no-cache"); // always revalidate, answered by 304
+            exchange.getResponseHeaders().set("Vary", "Accept-Encoding");
+            
+            if (etagMatches(exchange.getRequestHeaders().getFirst("If-None-Match"), etag)) {
+                exchange.sendResponseHeaders(304, -1);
+                exchange.close();
+                return;
+            }
+            
+            if (encoding != null) {
+                exchange.getResponseHeaders().set("Content-Encoding", encoding);
+            }
+            if ("HEAD".equals(method)) {
+                exchange.getResponseHeaders().set("Content-Length", String.valueOf(body.length));
+                exchange.sendResponseHeaders(200, -1);
+                exchange.close();
+                return;
+            }
+            exchange.sendResponseHeaders(200, body.length);
+            try (OutputStream os = exchange.getResponseBody()) {
+                os.write(body);
+            }
+        }
+        
+        private boolean accepts(String acceptEncoding, String coding) {
+            if (acceptEncoding == null) return false;
+            for (String part : acceptEncoding.split(",")) {
+                String[] fields = part.trim().split(";");
+                if (!fields[0].trim().equalsIgnoreCase(coding)) continue;
+                for (int i = 1; i < fields.length; i++) {
+                    String param = fields[i].trim();
+                    if (param.startsWith("q=")) {
+                        try {
+                            return Double.parseDouble(param.substring(2)) > 0;
+                        } catch (NumberFormatException e) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
             }
+            return false;
         }
         
-        private String getContentType(String path) {
-            if (path.endsWith(".html")) return "text/html";
-            if (path.endsWith(".css")) return "text/css";
-            if (path.endsWith(".js")) return "application/javascript";
-            if (path.endsWith(".json")) return "application/json";
-            return "text/plain";
+        // If-None-Match uses weak comparison, so a W/ prefix still matches
+        private boolean etagMatches(String ifNoneMatch, String etag) {
+            if (ifNoneMatch == null) return false;
+            for (String candidate : ifNoneMatch.split(",")) {
+                candidate = candidate.trim();
+                if (candidate.startsWith("W/")) candidate = candidate.substring(2);
+                if (candidate.equals("*") || candidate.equals(etag)) return true;
+            }
+            return false;
+        }
+    }
+    
+    private static String getContentType(String path) {
+        if (path.endsWith(".html")) return "text/html; charset=utf-8";
+        if (path.endsWith(".css")) return "text/css; charset=utf-8";
+        if (path.endsWith(".js")) return "application/javascript; charset=utf-8";
+        if (path.endsWith(".json")) return "application/json";
+        if (path.endsWith(".svg")) return "image/svg+xml";
+        if (path.endsWith(".png")) return "image/png";
+        if (path.endsWith(".ico")) return "image/x-icon";
+        return "text/plain";
+    }
+    
+    private static byte[] gzip(byte[] data) throws IOException {
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        try (GZIPOutputStream gzip = new GZIPOutputStream(out) {{ def.setLevel(Deflater.BEST_COMPRESSION); }}) {
+            gzip.write(data);
+        }
+        return out.toByteArray();
+    }
+    
+    private static String sha256Prefix(byte[] data) {
+        try {
+            byte[] digest = MessageDigest.getInstance("SHA-256").digest(data);
+            StringBuilder hex = new StringBuilder();
+            for (int i = 0; i < 16; i++) {
+                hex.append(String.format("%02x", digest[i]));
+            }
+            return hex.toString();
+        } catch (NoSuchAlgorithmException e) {
+            throw new IllegalStateException(e); // every JRE ships SHA-256
         }
     }
     
@@ -242,6 +487,7 @@ public class API {
         @Override
         public void handle(HttpExchange exchange) throws IOException {
             if ("POST".equals(exchange.getRequestMethod())) {
+        Trace trace = startTrace(exchange);
         String requestBody = readRequestBody(exchange);
         JSONObject jsonBody = new JSONObject(requestBody);
         String target = jsonBody.getString("target");
@@ -250,11 +496,13 @@ public class API {
     String commandToSend;
 if ("all".equalsIgnoreCase(target)) {
     commandToSend = "message_all " + messageContent; // New command for all clients
+} else if (target.startsWith("topic:")) {
+    commandToSend = "publish " + target.substring(6) + " " + messageContent; // Subscribers of one topic
 } else {
     commandToSend = "message_single " + target + " " + messageContent; // New command for single client
 }
 
-String response = sendCommandToCpp(commandToSend);
+String response = sendCommandToCpp(commandToSend, trace);
                 
                 // Ensure valid JSON response
                 if (!response.startsWith("{") && !response.startsWith("[")) {
@@ -262,6 +510,7 @@ String response = sendCommandToCpp(commandToSend);
                 }
                 
                 sendJsonResponse(exchange, 200, response);
+                finishTrace(trace);
             } else {
                 sendJsonResponse(exchange, 405, "{\"error\": \"Method not allowed\"}");
             }
@@ -272,13 +521,22 @@ class CommandHandler implements HttpHandler {
     @Override
     public void handle(HttpExchange exchange) throws IOException {
         if ("POST".equals(exchange.getRequestMethod())) {
+            Trace trace = startTrace(exchange);
             // Read the request body and parse it as a JSON object
             String requestBody = readRequestBody(exchange);
             JSONObject jsonBody = new JSONObject(requestBody);
             // Extract the "command" value from the JSON
             String command = jsonBody.getString("command");
             
-            String response = sendCommandToCpp(command);
+            String response;
+            if (command.startsWith("query_all ")) {
+                // Runs past the bridge timeout; only the final aggregate is returned
+                List<String> lines = new ArrayList<>();
+                streamQuery(command, lines::add);
+                response = lines.isEmpty() ? "{\"error\": \"No response from C++ server\"}" : lines.get(lines.size() - 1);
+            } else {
+                response = sendCommandToCpp(command, trace);
+            }
             
             // Ensure valid JSON response
             if (!response.startsWith("{") && !response.startsWith("[")) {
@@ -286,6 +544,7 @@ class CommandHandler implements HttpHandler {
             }
             
             sendJsonResponse(exchange, 200, response);
+            finishTrace(trace);
         } else {
             sendJsonResponse(exchange, 405, "{\"error\": \"Method not allowed\"}");
         }
@@ -330,7 +589,138 @@ class CommandHandler implements HttpHandler {
         }
     }
     
+    // Relays the C++ trace ring buffer: /api/trace lists recent traces,
+    // /api/trace?id=<id> shows one, /api/trace?format=chrome downloads
+    // Chrome trace JSON for chrome://tracing or Perfetto
+    class TraceHandler implements HttpHandler {
+        @Override
+        public void handle(HttpExchange exchange) throws IOException {
+            if (!"GET".equals(exchange.getRequestMethod())) {
+                sendJsonResponse(exchange, 405, "{\"error\": \"Method not allowed\"}");
+                return;
+            }
+            
+            Map<String, String> params = new HashMap<>();
+            String query = exchange.getRequestURI().getQuery();
+            if (query != null) {
+                for (String pair : query.split("&")) {
+                    int equals = pair.indexOf('=');
+                    if (equals > 0) {
+                        params.put(pair.substring(0, equals), pair.substring(equals + 1));
+                    }
+                }
+            }
+            
+            String id = params.getOrDefault("id", "");
+            if (!id.matches("[A-Za-z0-9_-]*")) {
+                sendJsonResponse(exchange, 400, "{\"error\": \"Invalid trace id\"}");
+                return;
+            }
+            
+            String command;
+            if ("chrome".equals(params.get("format"))) {
+                command = "trace chrome " + id;
+                exchange.getResponseHeaders().set("Content-Disposition", "attachment; filename=\"trace.json\"");
+            } else {
+                command = id.isEmpty() ? "trace" : "trace " + id;
+            }
+            sendJsonResponse(exchange, 200, sendCommandToCpp(command.trim()));
+        }
+    }
+    
+    // Streams a fleet query as newline-delimited JSON: progress objects as
+    // answers arrive, then the final aggregate ("final": true).
+    // /api/query?kind=os[&topic=<name>|&ip=<a,b>][&timeout=<s>]
+    class QueryHandler implements HttpHandler {
+        @Override
+        public void handle(HttpExchange exchange) throws IOException {
+            if (!"GET".equals(exchange.getRequestMethod())) {
+                sendJsonResponse(exchange, 405, "{\"error\": \"Method not allowed\"}");
+                return;
+            }
+            
+            Map<String, String> params = new HashMap<>();
+            String query = exchange.getRequestURI().getQuery();
+            if (query != null) {
+                for (String pair : query.split("&")) {
+                    int equals = pair.indexOf('=');
+                    if (equals > 0) {
+                        params.put(pair.substring(0, equals), URLDecoder.decode(pair.substring(equals + 1), "UTF-8"));
+                    }
+                }
+            }
+            
+            StringBuilder command = new StringBuilder("query_all");
+            for (String key : new String[] {"kind", "topic", "ip", "timeout"}) {
+                String value = params.get(key);
+                if (value == null) continue;
+                if (!value.matches("[A-Za-z0-9_.,:-]+")) {
+                    sendJsonResponse(exchange, 400, "{\"error\": \"Invalid " + key + "\"}");
+                    return;
+                }
+                command.append(' ').append(key.equals("kind") ? "" : key + "=").append(value);
+            }
+            
+            exchange.getResponseHeaders().set("Content-Type", "application/x-ndjson");
+            exchange.getResponseHeaders().set("Access-Control-Allow-Origin", "*");
+            exchange.sendResponseHeaders(200, 0); // chunked
+            try (OutputStream os = exchange.getResponseBody()) {
+                streamQuery(command.toString(), line -> {
+                    try {
+                        os.write((line + "\n").getBytes("UTF-8"));
+                        os.flush();
+                    } catch (IOException e) {
+                        throw new UncheckedIOException(e);
+                    }
+                });
+            } catch (UncheckedIOException e) {
+                // Browser went away; the C++ side finishes the query on its own
+            }
+        }
+    }
+    
+    // Queries block for their whole timeout, so they get their own bridge
+    // connection instead of holding the shared one
+    private void streamQuery(String command, java.util.function.Consumer<String> onLine) {
+        try (Socket socket = new Socket()) {
+            socket.connect(new InetSocketAddress(CPP_SERVER_HOST, CPP_SERVER_PORT), 3000);
+            socket.setSoTimeout(130000); // longest query timeout plus slack
+            PrintWriter out = new PrintWriter(socket.getOutputStream(), true);
+            BufferedReader in = new BufferedReader(new InputStreamReader(socket.getInputStream()));
+            out.println(command);
+            
+            String line;
+            while ((line = in.readLine()) != null && !line.equals("END_RESPONSE")) {
+                if (!line.isEmpty()) onLine.accept(line);
+            }
+        } catch (IOException e) {
+            onLine.accept("{\"error\": \"Communication failed: " + escapeJson(e.getMessage()) + "\"}");
+        }
+    }
+    
     // Helper methods
+    private Trace startTrace(HttpExchange exchange) {
+        long now = System.nanoTime();
+        boolean forced = exchange.getRequestHeaders().containsKey("X-Trace");
+        if (!forced && traceCounter.incrementAndGet() % TRACE_SAMPLE_EVERY != 0) {
+            return null;
+        }
+        
+        String id = Long.toHexString(now) + Long.toHexString(Thread.currentThread().getId());
+        exchange.getResponseHeaders().set("X-Trace-Id", id);
+        return new Trace(id, now);
+    }
+    
+    // Reports the stages the C++ server cannot see once the HTTP response is out
+    private void finishTrace(Trace trace) {
+        if (trace == null || trace.bridgeResponse == 0) {
+            return;
+        }
+        long httpRespond = System.nanoTime();
+        sendCommandToCpp("trace_report " + trace.id + " bridge_response=" + trace.bridgeResponse
+                + " http_respond=" + httpRespond);
+    }
+    
     private String readRequestBody(HttpExchange exchange) throws IOException {
         try (BufferedReader reader = new BufferedReader(
                 new InputStreamReader(exchange.getRequestBody()))) {
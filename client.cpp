@@ -7,6 +7,7 @@
 #include <iomanip>
 #include <atomic>
 #include <vector>
+#include <set>
 #include <cstring>
 
 // Windows includes
@@ -16,10 +17,16 @@
 #include <shellapi.h>
 #include <shlobj.h>
 #include <process.h>
+#include <zlib.h>
 
 // Link required libraries
 #pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "shell32.lib")
+#pragma comment(lib, "zlib.lib")
+#pragma comment(lib, "advapi32.lib")
+
+// Reported to query_all build
+static const char* CLIENT_BUILD = __DATE__ " " __TIME__;
 
 // Safe string copy function for cross-platform compatibility
 void safe_strcpy(char* dest, size_t dest_size, const char* src) {
@@ -54,23 +61,64 @@ private:
     HANDLE connectionThread;
     HANDLE pingThread;
     HANDLE messageThread;
+    HANDLE uploadThread;
+    
+    // Ping and upload threads share the socket; frames must not interleave
+    CRITICAL_SECTION sendMutex;
+    
+    // Upload (one transfer at a time, see server UploadManager for the protocol)
+    static const size_t UPLOAD_CHUNK_SIZE = 64 * 1024;
+    static const long long UPLOAD_WINDOW = 4 * UPLOAD_CHUNK_SIZE;
+    CRITICAL_SECTION uploadMutex;
+    CONDITION_VARIABLE uploadCredit;
+    volatile bool uploadActive;
+    unsigned long long uploadId;
+    std::string uploadName;
+    long long uploadAcked;
+    bool uploadRefused;
+    
+    // Topics announced in the handshake; the server can change them at runtime
+    CRITICAL_SECTION topicsMutex;
+    std::set<std::string> topics;
+    
+    // Compressed frames (see server PayloadCodec). The optional preset
+    // dictionary is payload.dict next to the executable, the same file the
+    // server loads; a partial ZMSG frame waits in compressedBuffer.
+    std::string dictionary;
+    uLong dictionaryId;
+    std::string compressedBuffer;
     
 public:
-    WindowsClient(const std::string& host = "127.0.0.1", int port = 9998) 
+    WindowsClient(const std::string& host = "127.0.0.1", int port = 9998, const std::string& topicList = "") 
         : serverHost(host), serverPort(port), connected(false), shouldRun(true), 
           clientSocket(INVALID_SOCKET), hwnd(nullptr),
-          connectionThread(NULL), pingThread(NULL), messageThread(NULL) {
+          connectionThread(NULL), pingThread(NULL), messageThread(NULL), uploadThread(NULL),
+          uploadActive(false), uploadId(0), uploadAcked(-1), uploadRefused(false), dictionaryId(0) {
         
         InitializeCriticalSection(&logMutex);
+        InitializeCriticalSection(&sendMutex);
+        InitializeCriticalSection(&uploadMutex);
+        InitializeConditionVariable(&uploadCredit);
+        InitializeCriticalSection(&topicsMutex);
+        
+        std::istringstream list(topicList);
+        std::string topic;
+        while (std::getline(list, topic, ',')) {
+            if (!topic.empty()) topics.insert(topic);
+        }
         initializeWinsock();
         setupLogFile();
         setupSystemTray();
+        loadDictionary();
         
         log("Client initialized - " + serverHost + ":" + std::to_string(serverPort));
     }
     
     ~WindowsClient() {
         cleanup();
+        DeleteCriticalSection(&topicsMutex);
+        DeleteCriticalSection(&uploadMutex);
+        DeleteCriticalSection(&sendMutex);
         DeleteCriticalSection(&logMutex);
     }
     
@@ -116,6 +164,22 @@ private:
         }
     }
     
+    void loadDictionary() {
+        char path[MAX_PATH];
+        DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+        std::string dir(path, length);
+        dir = dir.substr(0, dir.find_last_of("\\/") + 1);
+        
+        std::ifstream file(dir + "payload.dict", std::ios::binary);
+        if (!file) return;
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        dictionary = contents.str();
+        if (!dictionary.empty()) {
+            dictionaryId = adler32(adler32(0L, Z_NULL, 0), (const Bytef*)dictionary.data(), (uInt)dictionary.size());
+        }
+    }
+    
     void setupSystemTray() {
         // Register window class
         WNDCLASSA wc = {};
@@ -229,6 +293,12 @@ private:
         return 0;
     }
     
+    static unsigned __stdcall uploadThreadProc(void* param) {
+        WindowsClient* client = static_cast<WindowsClient*>(param);
+        client->uploadLoop();
+        return 0;
+    }
+    
     void connectionLoop() {
         while (shouldRun) {
             if (!connected) {
@@ -238,8 +308,8 @@ private:
                     updateTrayIcon(true);
                     log("Connected successfully");
                     
-                    // Send initial message
-                    sendMessage("CLIENT_CONNECTED");
+                    // Send initial message with our topics
+                    sendMessage(handshake());
                     
                     // Start communication threads
                     pingThread = (HANDLE)_beginthreadex(NULL, 0, pingThreadProc, this, 0, NULL);
@@ -267,6 +337,23 @@ private:
         }
     }
     
+    std::string handshake() {
+        EnterCriticalSection(&topicsMutex);
+        std::string message = "CLIENT_CONNECTED compress=deflate";
+        if (dictionaryId != 0) {
+            char id[16];
+            sprintf_s(id, sizeof(id), ":%08lx", dictionaryId);
+            message += id;
+        }
+        std::string separator = " topics=";
+        for (const auto& topic : topics) {
+            message += separator + topic;
+            separator = ",";
+        }
+        LeaveCriticalSection(&topicsMutex);
+        return message;
+    }
+    
     bool connectToServer() {
         // Clean up existing socket
         if (clientSocket != INVALID_SOCKET) {
@@ -324,6 +411,7 @@ private:
     
     void messageLoop() {
         char buffer[1024];
+        compressedBuffer.clear();
         
         while (connected && shouldRun) {
             memset(buffer, 0, sizeof(buffer));
@@ -344,21 +432,74 @@ private:
         disconnected();
     }
     
+    // Every frame to the server ends in a newline
     bool sendMessage(const std::string& message) {
+        if (!message.empty() && message.back() == '\n') {
+            return sendFrame(message, nullptr, 0);
+        }
+        return sendFrame(message + "\n", nullptr, 0);
+    }
+    
+    // Sends header and optional payload back to back under sendMutex
+    bool sendFrame(const std::string& header, const char* payload, size_t payloadLength) {
         if (clientSocket == INVALID_SOCKET || !connected) {
             return false;
         }
         
-        int result = send(clientSocket, message.c_str(), (int)message.length(), 0);
-        if (result == SOCKET_ERROR) {
+        EnterCriticalSection(&sendMutex);
+        bool ok = sendAll(header.c_str(), header.length()) && sendAll(payload, payloadLength);
+        LeaveCriticalSection(&sendMutex);
+        
+        if (!ok) {
             log("Send failed: " + std::to_string(WSAGetLastError()));
-            return false;
         }
-        
+        return ok;
+    }
+    
+    bool sendAll(const char* data, size_t length) {
+        while (length > 0) {
+            int result = send(clientSocket, data, (int)length, 0);
+            if (result == SOCKET_ERROR) {
+                return false;
+            }
+            data += result;
+            length -= result;
+        }
         return true;
     }
     
-    void processMessage(const std::string& message) {
+    void processMessage(const std::string& received) {
+        // Compressed frames carry binary data and may span receives; text
+        // before the first one is handled as usual
+        size_t zmsg = compressedBuffer.empty() ? received.find("ZMSG:") : 0;
+        if (zmsg != std::string::npos) {
+            if (zmsg > 0) processMessage(received.substr(0, zmsg));
+            compressedBuffer += received.substr(zmsg);
+            drainCompressed();
+            return;
+        }
+        handleTextMessage(received);
+    }
+    
+    void handleTextMessage(const std::string& received) {
+        // Upload and query frames are newline-terminated and may arrive glued
+        // to other messages, so pull them out before the exact matches below
+        std::string message = received;
+        size_t pos;
+        while ((pos = message.find("UPLOAD_")) != std::string::npos) {
+            size_t end = message.find('\n', pos);
+            if (end == std::string::npos) break;
+            handleUploadFrame(message.substr(pos, end - pos));
+            message.erase(pos, end - pos + 1);
+        }
+        while ((pos = message.find("QUERY:")) != std::string::npos) {
+            size_t end = message.find('\n', pos);
+            if (end == std::string::npos) break;
+            answerQuery(message.substr(pos + 6, end - pos - 6));
+            message.erase(pos, end - pos + 1);
+        }
+        if (message.empty()) return;
+        
         log("Received: " + message);
         
         if (message == "PONG") {
@@ -379,12 +520,255 @@ private:
             log("Server message: " + msg);
             showNotification("Server Message", msg);
         }
+        else if (message.compare(0, 6, "TOPIC:") == 0) {
+            // TOPIC:<topic>:<text>
+            size_t colon = message.find(':', 6);
+            if (colon == std::string::npos) return;
+            std::string topic = message.substr(6, colon - 6);
+            std::string msg = message.substr(colon + 1);
+            log("Topic message (" + topic + "): " + msg);
+            showNotification("Server Message - " + topic, msg);
+        }
+        else if (message.compare(0, 10, "SUBSCRIBE:") == 0) {
+            EnterCriticalSection(&topicsMutex);
+            topics.insert(message.substr(10));
+            LeaveCriticalSection(&topicsMutex);
+            log("Subscribed to topic " + message.substr(10));
+        }
+        else if (message.compare(0, 12, "UNSUBSCRIBE:") == 0) {
+            EnterCriticalSection(&topicsMutex);
+            topics.erase(message.substr(12));
+            LeaveCriticalSection(&topicsMutex);
+            log("Unsubscribed from topic " + message.substr(12));
+        }
         else if (message == "AUTO_UPDATE_CHECK") {
             log("Auto-update check received");
             // Implement auto-update logic here
         }
     }
     
+    // "<id>:<kind>" from a server query_all; unknown kinds answer "!..."
+    void answerQuery(const std::string& request) {
+        size_t colon = request.find(':');
+        if (colon == std::string::npos) return;
+        std::string id = request.substr(0, colon);
+        std::string kind = request.substr(colon + 1);
+        
+        std::string value;
+        if (kind == "os") {
+            value = osVersion();
+        } else if (kind == "build") {
+            value = CLIENT_BUILD;
+        } else if (kind == "hostname") {
+            char name[MAX_COMPUTERNAME_LENGTH + 1];
+            DWORD size = sizeof(name);
+            value = GetComputerNameA(name, &size) ? std::string(name, size) : "!unavailable";
+        } else if (kind == "uptime") {
+            value = std::to_string(GetTickCount64() / 1000);
+        } else if (kind == "disk_free") {
+            ULARGE_INTEGER freeBytes;
+            value = GetDiskFreeSpaceExA("C:\\", &freeBytes, nullptr, nullptr)
+                ? std::to_string(freeBytes.QuadPart / (1024.0 * 1024 * 1024)) : "!unavailable";
+        } else {
+            value = "!unknown kind";
+        }
+        
+        log("Query " + id + " (" + kind + "): " + value);
+        sendMessage("QUERY_RESULT:" + id + ":" + value + "\n");
+    }
+    
+    std::string osVersion() {
+        char product[128];
+        char build[32];
+        DWORD productSize = sizeof(product);
+        DWORD buildSize = sizeof(build);
+        const char* key = "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion";
+        if (RegGetValueA(HKEY_LOCAL_MACHINE, key, "ProductName", RRF_RT_REG_SZ, nullptr, product, &productSize) != ERROR_SUCCESS) {
+            return "!unavailable";
+        }
+        std::string version = product;
+        if (RegGetValueA(HKEY_LOCAL_MACHINE, key, "CurrentBuildNumber", RRF_RT_REG_SZ, nullptr, build, &buildSize) == ERROR_SUCCESS) {
+            version += std::string(" (build ") + build + ")";
+        }
+        return version;
+    }
+    
+    // Inflates every complete "ZMSG:<encoding>:<raw length>:<length>\n" frame
+    void drainCompressed() {
+        while (!compressedBuffer.empty()) {
+            if (compressedBuffer.compare(0, 5, "ZMSG:") != 0) {
+                // Plain text after a compressed frame
+                std::string rest = compressedBuffer;
+                compressedBuffer.clear();
+                processMessage(rest);
+                return;
+            }
+            size_t end = compressedBuffer.find('\n');
+            if (end == std::string::npos) return;
+            
+            int encoding = 0;
+            unsigned long rawLength = 0, length = 0;
+            if (sscanf_s(compressedBuffer.c_str(), "ZMSG:%d:%lu:%lu", &encoding, &rawLength, &length) != 3
+                    || rawLength > 16 * 1024 * 1024) {
+                log("Malformed compressed frame, discarding");
+                compressedBuffer.clear();
+                return;
+            }
+            if (compressedBuffer.size() < end + 1 + length) return;
+            
+            std::string text = inflateFrame(compressedBuffer.substr(end + 1, length), rawLength);
+            compressedBuffer.erase(0, end + 1 + length);
+            if (text.empty()) {
+                log("Failed to decompress frame");
+            } else {
+                handleTextMessage(text);
+            }
+        }
+    }
+    
+    std::string inflateFrame(const std::string& body, unsigned long rawLength) {
+        z_stream stream = {};
+        if (inflateInit(&stream) != Z_OK) return "";
+        
+        std::string text(rawLength, '\0');
+        stream.next_in = (Bytef*)body.data();
+        stream.avail_in = (uInt)body.size();
+        stream.next_out = (Bytef*)&text[0];
+        stream.avail_out = (uInt)text.size();
+        int result = inflate(&stream, Z_FINISH);
+        if (result == Z_NEED_DICT && !dictionary.empty()) {
+            inflateSetDictionary(&stream, (const Bytef*)dictionary.data(), (uInt)dictionary.size());
+            result = inflate(&stream, Z_FINISH);
+        }
+        bool complete = result == Z_STREAM_END && stream.total_out == rawLength;
+        inflateEnd(&stream);
+        return complete ? text : "";
+    }
+    
+    void handleUploadFrame(const std::string& frame) {
+        std::vector<std::string> fields;
+        std::istringstream iss(frame);
+        std::string field;
+        while (std::getline(iss, field, ':')) fields.push_back(field);
+        if (fields.size() < 3) return;
+        
+        unsigned long long id = strtoull(fields[1].c_str(), nullptr, 10);
+        
+        if (fields[0] == "UPLOAD_REQUEST" && fields.size() == 4) {
+            EnterCriticalSection(&uploadMutex);
+            bool busy = uploadActive;
+            if (!busy) {
+                uploadActive = true;
+                uploadId = id;
+                uploadName = fields[3];
+                uploadAcked = -1;
+                uploadRefused = false;
+            }
+            LeaveCriticalSection(&uploadMutex);
+            
+            if (busy) {
+                sendMessage("UPLOAD_ERROR:" + std::to_string(id) + ":busy\n");
+                return;
+            }
+            
+            log("Upload requested: " + fields[3]);
+            if (uploadThread) {
+                WaitForSingleObject(uploadThread, INFINITE);
+                CloseHandle(uploadThread);
+            }
+            uploadThread = (HANDLE)_beginthreadex(NULL, 0, uploadThreadProc, this, 0, NULL);
+        }
+        else if (fields[0] == "UPLOAD_ACK") {
+            EnterCriticalSection(&uploadMutex);
+            if (uploadActive && id == uploadId) {
+                uploadAcked = strtoll(fields[2].c_str(), nullptr, 10);
+                WakeAllConditionVariable(&uploadCredit);
+            }
+            LeaveCriticalSection(&uploadMutex);
+        }
+        else if (fields[0] == "UPLOAD_ERROR") {
+            // The server gave up on the request, e.g. it expired before we answered
+            EnterCriticalSection(&uploadMutex);
+            if (uploadActive && id == uploadId) {
+                uploadRefused = true;
+                WakeAllConditionVariable(&uploadCredit);
+            }
+            LeaveCriticalSection(&uploadMutex);
+            log("Upload refused by server: " + fields[2]);
+        }
+    }
+    
+    // Waits until the server has acknowledged at least minAcked bytes.
+    // Returns the acked offset, or -1 if the connection went away or the
+    // server refused the upload.
+    long long waitForAck(long long minAcked) {
+        EnterCriticalSection(&uploadMutex);
+        while (connected && shouldRun && !uploadRefused && uploadAcked < minAcked) {
+            SleepConditionVariableCS(&uploadCredit, &uploadMutex, 1000);
+        }
+        long long acked = (connected && shouldRun && !uploadRefused) ? uploadAcked : -1;
+        LeaveCriticalSection(&uploadMutex);
+        return acked;
+    }
+    
+    // Streams the requested file in chunks, keeping at most UPLOAD_WINDOW
+    // unacknowledged bytes in flight so PINGs are never starved
+    void uploadLoop() {
+        std::string id = std::to_string(uploadId);
+        std::string path;
+        if (uploadName == "log") {
+            path = logFilePath;
+        }
+        
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (path.empty() || !file.is_open()) {
+            log("Upload refused: unknown file " + uploadName);
+            sendMessage("UPLOAD_ERROR:" + id + ":unavailable\n");
+            uploadActive = false;
+            return;
+        }
+        
+        long long total = (long long)file.tellg();
+        sendMessage("UPLOAD_BEGIN:" + id + ":" + std::to_string(total) + "\n");
+        
+        // The first ack tells us where the server's partial copy ends
+        long long offset = waitForAck(0);
+        std::vector<char> chunk(UPLOAD_CHUNK_SIZE);
+        
+        while (offset >= 0 && offset < total) {
+            if (waitForAck(offset + (long long)UPLOAD_CHUNK_SIZE - UPLOAD_WINDOW) < 0) {
+                offset = -1;
+                break;
+            }
+            
+            long long left = total - offset;
+            size_t length = left < (long long)UPLOAD_CHUNK_SIZE ? (size_t)left : UPLOAD_CHUNK_SIZE;
+            file.seekg(offset);
+            file.read(chunk.data(), length);
+            if ((size_t)file.gcount() != length) {
+                sendMessage("UPLOAD_ERROR:" + id + ":read_failed\n");
+                offset = -1;
+                break;
+            }
+            
+            std::string header = "UPLOAD_CHUNK:" + id + ":" + std::to_string(offset) + ":" + std::to_string(length) + "\n";
+            if (!sendFrame(header, chunk.data(), length)) {
+                offset = -1;
+                break;
+            }
+            offset += length;
+        }
+        
+        if (offset == total && waitForAck(total) == total) {
+            sendMessage("UPLOAD_END:" + id + "\n");
+            log("Upload complete: " + uploadName + " (" + std::to_string(total) + " bytes)");
+        } else {
+            log("Upload interrupted: " + uploadName);
+        }
+        
+        uploadActive = false;
+    }
+    
     void showNotification(const std::string& title, const std::string& message) {
         // Simple notification using the tooltip instead of balloon tips
         // since older Windows versions may not support balloon notifications
@@ -413,6 +797,11 @@ private:
                 clientSocket = INVALID_SOCKET;
             }
             
+            // Wake a waiting upload so it can give up
+            EnterCriticalSection(&uploadMutex);
+            WakeAllConditionVariable(&uploadCredit);
+            LeaveCriticalSection(&uploadMutex);
+            
             log("Disconnected from server");
         }
     }
@@ -436,6 +825,11 @@ private:
             CloseHandle(messageThread);
             messageThread = NULL;
         }
+        if (uploadThread) {
+            WaitForSingleObject(uploadThread, 1000);
+            CloseHandle(uploadThread);
+            uploadThread = NULL;
+        }
         
         // Cleanup tray icon
         Shell_NotifyIconA(NIM_DELETE, &nid);
@@ -488,10 +882,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     
     std::string host = "127.0.0.1";
     int port = 9998;
+    std::string topicList;
     
-    // Parse command line
+    // Parse command line: <host>[:<port>] [<topic>,<topic>...]
     if (strlen(lpCmdLine) > 0) {
         std::string cmd(lpCmdLine);
+        size_t space = cmd.find(' ');
+        if (space != std::string::npos) {
+            topicList = cmd.substr(space + 1);
+            cmd = cmd.substr(0, space);
+        }
         size_t pos = cmd.find(':');
         if (pos != std::string::npos) {
             host = cmd.substr(0, pos);
@@ -501,7 +901,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         }
     }
     
-    WindowsClient client(host, port);
+    WindowsClient client(host, port, topicList);
     client.start();
     
     return 0;
@@ -510,6 +910,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 int main(int argc, char* argv[]) {
     std::string host = "192.168.2.145";
     int port = 9998;
+    std::string topicList;
     
     if (argc > 1) {
         std::string arg(argv[1]);
@@ -521,8 +922,11 @@ int main(int argc, char* argv[]) {
             host = arg;
         }
     }
+    if (argc > 2) {
+        topicList = argv[2];
+    }
     
-    WindowsClient client(host, port);
+    WindowsClient client(host, port, topicList);
     client.start();
     
     return 0;
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <ctime>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Remembers every client identity the server has seen so a restart does not
+// start from an empty fleet. State lives in a fixed-layout snapshot that is
+// loaded with mmap plus an append-only delta log of connect/disconnect
+// events since that snapshot. compact() folds the log into a new snapshot.
+class ClientRegistry {
+public:
+    struct Entry {
+        std::string ip;
+        int64_t firstSeen = 0;
+        int64_t lastSeen = 0;
+        int64_t lastConnect = 0;
+        uint32_t connects = 0;
+        int sessions = 0;   // live connections, never persisted
+    };
+
+private:
+    static const uint32_t SNAPSHOT_MAGIC = 0x53524753; // "SGRS"
+    static const uint32_t SNAPSHOT_VERSION = 1;
+    static const size_t IP_LENGTH = 48;
+
+    enum EventType : uint8_t { EventConnect = 1, EventDisconnect = 2 };
+
+    struct SnapshotHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t count;
+        uint64_t lastSequence;  // log records up to here are folded in
+    };
+
+    struct SnapshotRecord {
+        char ip[IP_LENGTH];
+        int64_t firstSeen;
+        int64_t lastSeen;
+        int64_t lastConnect;
+        uint32_t connects;
+        uint32_t reserved;
+    };
+
+    struct LogRecord {
+        uint64_t sequence;
+        int64_t time;
+        char ip[IP_LENGTH];
+        uint8_t type;
+        uint8_t reserved[7];
+    };
+
+    std::map<std::string, Entry> entries;
+    std::mutex registryMutex;
+    std::mutex compactMutex;    // one snapshot write at a time
+    std::string snapshotPath;
+    std::string logPath;
+    int logFd = -1;
+    uint64_t sequence = 0;
+    uint64_t unsaved = 0;   // changes since the last snapshot
+
+public:
+    ClientRegistry(const std::string& snapshot, const std::string& log)
+        : snapshotPath(snapshot), logPath(log) {}
+
+    ~ClientRegistry() {
+        if (logFd >= 0) close(logFd);
+    }
+
+    // Maps the snapshot, replays newer log records and opens the log for
+    // appending. Returns the number of identities restored.
+    size_t load() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        uint64_t snapshotSequence = loadSnapshot();
+        sequence = snapshotSequence;
+        replayLog(snapshotSequence);
+        logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        return entries.size();
+    }
+
+    // Returns the previous entry so the caller can tell a new client from a
+    // returning one (firstSeen == 0 means never seen).
+    Entry connected(const std::string& ip, time_t now) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Entry& entry = entries[ip];
+        Entry previous = entry;
+        apply(ip, EventConnect, now);
+        appendLog(ip, EventConnect, now);
+        return previous;
+    }
+
+    void disconnected(const std::string& ip, time_t now) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        apply(ip, EventDisconnect, now);
+        appendLog(ip, EventDisconnect, now);
+    }
+
+    // Last-seen times change on every ping, so they are not logged; the
+    // caller passes them in here right before compact().
+    void updateLastSeen(const std::vector<std::pair<std::string, time_t>>& seen) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const auto& item : seen) {
+            auto it = entries.find(item.first);
+            if (it != entries.end() && item.second > it->second.lastSeen) {
+                it->second.lastSeen = item.second;
+                unsaved++;
+            }
+        }
+    }
+
+    // Writes every entry to a new snapshot and empties the log. The log is
+    // only truncated after the rename, and replay skips records the
+    // snapshot already covers, so a crash in between loses nothing.
+    // Nothing is written when no entry changed since the last snapshot.
+    // The records are copied under the registry lock; writing and syncing
+    // the file happen outside it so connects are not held up by the disk.
+    bool compact() {
+        std::lock_guard<std::mutex> compacting(compactMutex);
+        SnapshotHeader snapshot{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0, 0};
+        std::vector<SnapshotRecord> records;
+        uint64_t taken;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            if (unsaved == 0) return true;
+            taken = unsaved;
+            snapshot.count = entries.size();
+            snapshot.lastSequence = sequence;
+            records.resize(entries.size());
+            SnapshotRecord* record = records.data();
+            for (const auto& item : entries) {
+                const Entry& entry = item.second;
+                memset(record, 0, sizeof(*record));
+                strncpy(record->ip, entry.ip.c_str(), IP_LENGTH - 1);
+                record->firstSeen = entry.firstSeen;
+                record->lastSeen = entry.lastSeen;
+                record->lastConnect = entry.lastConnect;
+                record->connects = entry.connects;
+                record++;
+            }
+        }
+
+        std::string tmpPath = snapshotPath + ".tmp";
+        size_t size = sizeof(SnapshotHeader) + records.size() * sizeof(SnapshotRecord);
+
+        int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, size) < 0) {
+            close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        SnapshotHeader* header = static_cast<SnapshotHeader*>(map);
+        *header = snapshot;
+        if (!records.empty()) {
+            memcpy(header + 1, records.data(), records.size() * sizeof(SnapshotRecord));
+        }
+
+        bool ok = msync(map, size, MS_SYNC) == 0;
+        munmap(map, size);
+        close(fd);
+        if (!ok || rename(tmpPath.c_str(), snapshotPath.c_str()) < 0) return false;
+
+        // Changes made while the file was written stay unsaved, and log
+        // records appended meanwhile are kept for the next load
+        std::lock_guard<std::mutex> lock(registryMutex);
+        unsaved -= taken;
+        if (sequence != snapshot.lastSequence) return true;
+        if (logFd >= 0 && ftruncate(logFd, 0) < 0) return false;
+        return true;
+    }
+
+    // Known identities with no live connection, offline for at least
+    // minSeconds, most recently seen first.
+    std::vector<Entry> offline(time_t now, long minSeconds) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::vector<Entry> result;
+        for (const auto& item : entries) {
+            const Entry& entry = item.second;
+            if (entry.sessions == 0 && now - entry.lastSeen >= minSeconds) {
+                result.push_back(entry);
+            }
+        }
+        std::sort(result.begin(), result.end(),
+            [](const Entry& a, const Entry& b) { return a.lastSeen > b.lastSeen; });
+        return result;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        return entries.size();
+    }
+
+private:
+    void apply(const std::string& ip, uint8_t type, int64_t when) {
+        Entry& entry = entries[ip];
+        entry.ip = ip;
+        unsaved++;
+        if (entry.firstSeen == 0) entry.firstSeen = when;
+        entry.lastSeen = std::max(entry.lastSeen, when);
+        if (type == EventConnect) {
+            entry.lastConnect = when;
+            entry.connects++;
+            entry.sessions++;
+        } else if (entry.sessions > 0) {
+            entry.sessions--;
+        }
+    }
+
+    void appendLog(const std::string& ip, uint8_t type, int64_t when) {
+        if (logFd < 0) return;
+        LogRecord record{};
+        record.sequence = ++sequence;
+        record.time = when;
+        record.type = type;
+        strncpy(record.ip, ip.c_str(), IP_LENGTH - 1);
+        // Single write of a fixed-size record; a torn tail is ignored on replay
+        if (write(logFd, &record, sizeof(record)) != sizeof(record)) {
+            sequence--;
+        }
+    }
+
+    uint64_t loadSnapshot() {
+        int fd = open(snapshotPath.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+            close(fd);
+            return 0;
+        }
+
+        size_t size = st.st_size;
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return 0;
+
+        const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map);
+        uint64_t lastSequence = 0;
+        if (header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION
+                && header->count <= (size - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord)) {
+            const SnapshotRecord* record = reinterpret_cast<const SnapshotRecord*>(header + 1);
+            for (uint64_t i = 0; i < header->count; i++, record++) {
+                Entry entry;
+                entry.ip.assign(record->ip, strnlen(record->ip, IP_LENGTH));
+                entry.firstSeen = record->firstSeen;
+                entry.lastSeen = record->lastSeen;
+                entry.lastConnect = record->lastConnect;
+                entry.connects = record->connects;
+                entries[entry.ip] = entry;
+            }
+            lastSequence = header->lastSequence;
+        }
+
+        munmap(map, size);
+        return lastSequence;
+    }
+
+    void replayLog(uint64_t afterSequence) {
+        int fd = open(logPath.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        LogRecord record;
+        while (read(fd, &record, sizeof(record)) == sizeof(record)) {
+            if (record.sequence <= afterSequence) continue;
+            std::string ip(record.ip, strnlen(record.ip, IP_LENGTH));
+            apply(ip, record.type, record.time);
+            sequence = std::max(sequence, record.sequence);
+        }
+        close(fd);
+
+        // Sessions from before the restart are gone
+        for (auto& item : entries) item.second.sessions = 0;
+    }
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+// Fleet-wide queries. The server sends "QUERY:<id>:<kind>\n" to each target
+// and clients answer "QUERY_RESULT:<id>:<value>\n" (a value starting with
+// '!' is an error). Answers are folded into the query's aggregate as they
+// arrive, so memory and work stay per distinct value rather than per
+// client: counts and top-K for text kinds, min/max/mean and a histogram for
+// numeric ones. Targets that disconnect before answering are counted as
+// failed; those still silent at the deadline are the stragglers.
+class FleetQueries {
+public:
+    struct Kind {
+        const char* name;
+        bool numeric;
+        const char* unit;
+        double scale;                // reported value * scale = value in unit
+        std::vector<double> buckets; // histogram lower bounds, numeric kinds only
+    };
+
+    struct Target {
+        int socket;
+        std::string ip;
+    };
+
+    static const size_t TOP_K = 10;
+    static const size_t MAX_DISTINCT = 10000;
+    static const size_t MAX_STRAGGLERS_LISTED = 50;
+    static const size_t MAX_VALUE_LENGTH = 128;
+
+    static const Kind* findKind(const std::string& name) {
+        static const std::vector<Kind> kinds = {
+            {"os", false, "", 1, {}},
+            {"build", false, "", 1, {}},
+            {"hostname", false, "", 1, {}},
+            {"uptime", true, "hours", 1.0 / 3600, {0, 1, 6, 24, 72, 168, 720}}, // clients report seconds
+            {"disk_free", true, "GB", 1, {0, 1, 5, 10, 25, 50, 100, 250}},
+        };
+        for (const auto& kind : kinds) {
+            if (name == kind.name) return &kind;
+        }
+        return nullptr;
+    }
+
+    static std::string kindNames() { return "os, build, hostname, uptime, disk_free"; }
+
+    class Query {
+        friend class FleetQueries;
+
+        const uint64_t id;
+        const Kind& kind;
+        const std::chrono::steady_clock::time_point started;
+        std::mutex queryMutex;
+        std::condition_variable changed;
+
+        std::unordered_map<int, std::string> pending; // socket -> ip
+        size_t targets;
+        size_t responded = 0;
+        size_t errors = 0;
+        size_t failed = 0;    // disconnected before answering
+        uint64_t updates = 0;
+
+        std::map<std::string, size_t> counts;
+        size_t otherCount = 0;
+        double minimum = std::numeric_limits<double>::max();
+        double maximum = std::numeric_limits<double>::lowest();
+        double sum = 0;
+        std::vector<size_t> histogram;
+
+    public:
+        Query(uint64_t queryId, const Kind& queryKind, const std::vector<Target>& to)
+            : id(queryId), kind(queryKind), started(std::chrono::steady_clock::now()),
+              targets(to.size()), histogram(queryKind.buckets.size(), 0) {
+            for (const auto& target : to) pending[target.socket] = target.ip;
+        }
+
+        uint64_t queryId() const { return id; }
+
+        // Sleeps for one interval, or less if every target answers. Returns
+        // false once every target answered or the deadline passed.
+        bool wait(std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds interval) {
+            std::unique_lock<std::mutex> lock(queryMutex);
+            auto wake = std::min(deadline, std::chrono::steady_clock::now() + interval);
+            changed.wait_until(lock, wake, [&] { return pending.empty(); });
+            return !pending.empty() && std::chrono::steady_clock::now() < deadline;
+        }
+
+        // True if answers arrived since the last call that returned true
+        bool takeUpdate(uint64_t& seen) {
+            std::lock_guard<std::mutex> lock(queryMutex);
+            if (updates == seen) return false;
+            seen = updates;
+            return true;
+        }
+
+        std::string json(bool final) {
+            std::lock_guard<std::mutex> lock(queryMutex);
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started).count();
+
+            std::ostringstream oss;
+            oss << "{\"query\": " << id << ", \"kind\": \"" << kind.name << "\", \"final\": "
+                << (final ? "true" : "false") << ", \"targets\": " << targets << ", \"responded\": " << responded
+                << ", \"errors\": " << errors << ", \"failed\": " << failed << ", \"pending\": " << pending.size()
+                << ", \"elapsed_ms\": " << elapsed;
+
+            if (kind.numeric) {
+                size_t valued = responded - errors;
+                oss << ", \"unit\": \"" << kind.unit << "\"";
+                if (valued > 0) {
+                    oss << ", \"min\": " << minimum << ", \"max\": " << maximum << ", \"mean\": " << sum / valued;
+                }
+                oss << ", \"histogram\": [";
+                for (size_t i = 0; i < histogram.size(); i++) {
+                    if (i > 0) oss << ",";
+                    oss << "{\"from\": " << kind.buckets[i];
+                    if (i + 1 < histogram.size()) oss << ", \"to\": " << kind.buckets[i + 1];
+                    oss << ", \"count\": " << histogram[i] << "}";
+                }
+                oss << "]";
+            } else {
+                std::vector<std::pair<size_t, const std::string*>> ranked;
+                ranked.reserve(counts.size());
+                for (const auto& entry : counts) ranked.emplace_back(entry.second, &entry.first);
+                size_t top = std::min(TOP_K, ranked.size());
+                std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(),
+                    [](const std::pair<size_t, const std::string*>& a, const std::pair<size_t, const std::string*>& b) {
+                        return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+                    });
+                oss << ", \"distinct\": " << counts.size() << ", \"top\": [";
+                for (size_t i = 0; i < top; i++) {
+                    if (i > 0) oss << ",";
+                    oss << "{\"value\": \"" << *ranked[i].second << "\", \"count\": " << ranked[i].first << "}";
+                }
+                oss << "]";
+                if (otherCount > 0) oss << ", \"other\": " << otherCount;
+            }
+
+            if (final) {
+                oss << ", \"stragglers\": [";
+                size_t listed = 0;
+                for (const auto& entry : pending) {
+                    if (listed == MAX_STRAGGLERS_LISTED) break;
+                    if (listed++ > 0) oss << ",";
+                    oss << "\"" << entry.second << "\"";
+                }
+                oss << "], \"straggler_count\": " << pending.size();
+            }
+            oss << "}";
+            return oss.str();
+        }
+
+    private:
+        // Caller holds queryMutex
+        void add(std::string value) {
+            if (!value.empty() && value[0] == '!') {
+                errors++;
+                return;
+            }
+            if (kind.numeric) {
+                // Text, nan and inf would poison min/max/mean; count them as errors
+                char* end = nullptr;
+                double number = strtod(value.c_str(), &end) * kind.scale;
+                if (end == value.c_str() || !std::isfinite(number)) {
+                    errors++;
+                    return;
+                }
+                minimum = std::min(minimum, number);
+                maximum = std::max(maximum, number);
+                sum += number;
+                size_t bucket = std::upper_bound(kind.buckets.begin(), kind.buckets.end(), number)
+                    - kind.buckets.begin();
+                histogram[bucket == 0 ? 0 : bucket - 1]++;
+            } else {
+                // Values end up in JSON; keep them printable and unquoted
+                for (char& c : value) {
+                    if (c == '"' || c == '\\' || (unsigned char)c < 0x20) c = '_';
+                }
+                auto it = counts.find(value);
+                if (it != counts.end()) {
+                    it->second++;
+                } else if (counts.size() < MAX_DISTINCT) {
+                    counts.emplace(value, 1);
+                } else {
+                    otherCount++;
+                }
+            }
+        }
+    };
+
+private:
+    std::map<uint64_t, std::shared_ptr<Query>> active;
+    std::mutex queriesMutex;
+    uint64_t nextId = 1;
+
+public:
+    std::shared_ptr<Query> start(const Kind& kind, const std::vector<Target>& targets) {
+        std::lock_guard<std::mutex> lock(queriesMutex);
+        auto query = std::make_shared<Query>(nextId++, kind, targets);
+        active[query->id] = query;
+        return query;
+    }
+
+    void finish(uint64_t id) {
+        std::lock_guard<std::mutex> lock(queriesMutex);
+        active.erase(id);
+    }
+
+    // "<id>:<value>" from a QUERY_RESULT frame. Late, duplicate and
+    // unsolicited answers are ignored.
+    void answer(int socket, const std::string& frame) {
+        size_t colon = frame.find(':');
+        if (colon == std::string::npos) return;
+        uint64_t id = strtoull(frame.c_str(), nullptr, 10);
+
+        std::shared_ptr<Query> query;
+        {
+            std::lock_guard<std::mutex> lock(queriesMutex);
+            auto it = active.find(id);
+            if (it == active.end()) return;
+            query = it->second;
+        }
+
+        std::lock_guard<std::mutex> lock(query->queryMutex);
+        if (!query->pending.erase(socket)) return;
+        query->responded++;
+        query->updates++;
+        query->add(frame.substr(colon + 1, MAX_VALUE_LENGTH));
+        query->changed.notify_all();
+    }
+
+    // A target disconnected; it will never answer the queries still
+    // waiting on it.
+    void clientGone(int socket) {
+        std::vector<std::shared_ptr<Query>> queries;
+        {
+            std::lock_guard<std::mutex> lock(queriesMutex);
+            for (const auto& entry : active) queries.push_back(entry.second);
+        }
+
+        for (const auto& query : queries) {
+            std::lock_guard<std::mutex> lock(query->queryMutex);
+            if (!query->pending.erase(socket)) continue;
+            query->failed++;
+            query->updates++;
+            query->changed.notify_all();
+        }
+    }
+};
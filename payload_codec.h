@@ -0,0 +1,196 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <zlib.h>
+
+// Optional compressed delivery of text frames. A client offers it in its
+// handshake ("CLIENT_CONNECTED compress=deflate[:<dictionary id>]"); frames
+// for such a client are sent as
+//
+//   ZMSG:<encoding>:<raw length>:<length>\n<zlib bytes>
+//
+// where the zlib stream inflates to the plain frame ("MSG:...", "TOPIC:...")
+// and encoding is 1 for plain deflate or 2 when it was compressed against
+// the shared preset dictionary. The dictionary is a file of common message
+// text deployed next to both server and client; its zlib (Adler-32) id is
+// what the client offers, so mismatched copies fall back to encoding 1.
+// Clients that offer nothing keep getting plain text.
+class PayloadCodec {
+public:
+    enum Encoding { Plain = 0, Deflate = 1, DeflateDictionary = 2 };
+
+    // Short frames do not shrink enough to pay for the header
+    static const size_t MIN_COMPRESS_BYTES = 256;
+
+    // One outgoing frame in every encoding its recipients need. Each
+    // compressed form is built at most once and shared by all recipients.
+    class Frame {
+        PayloadCodec& codec;
+        std::string plain;
+        std::string compressed[3];
+        bool built[3] = {true, false, false};
+        std::shared_ptr<const std::string> shared[3];
+
+    public:
+        Frame(PayloadCodec& owner, std::string text) : codec(owner), plain(std::move(text)) {}
+
+        const std::string& forSocket(int socket) { return forEncoding(codec.encodingFor(socket)); }
+
+        const std::string& forEncoding(Encoding encoding) {
+            if (encoding == Plain || plain.size() < MIN_COMPRESS_BYTES) return plain;
+            if (!built[encoding]) {
+                compressed[encoding] = codec.compress(plain, encoding);
+                built[encoding] = true;
+            }
+            // Empty when compression did not make the frame smaller
+            return compressed[encoding].empty() ? plain : compressed[encoding];
+        }
+
+        // The bytes forSocket returns, in a copy that writes finishing after
+        // the frame is gone can hold on to; one copy per encoding
+        std::shared_ptr<const std::string> sharedForSocket(int socket) {
+            const std::string& bytes = forSocket(socket);
+            int slot = &bytes == &plain ? Plain : (&bytes == &compressed[Deflate] ? Deflate : DeflateDictionary);
+            if (!shared[slot]) shared[slot] = std::make_shared<const std::string>(bytes);
+            return shared[slot];
+        }
+
+        const std::string& text() const { return plain; }
+    };
+
+private:
+    std::unordered_map<int, Encoding> encodings;
+    std::mutex codecMutex;
+    std::string dictionary;
+    uint32_t dictionaryId = 0;
+
+    // Totals for the compression command
+    std::atomic<uint64_t> framesCompressed{0};
+    std::atomic<uint64_t> compressMicros{0};
+    std::atomic<uint64_t> plainBytes{0};
+    std::atomic<uint64_t> sentBytes{0};
+
+public:
+    // Missing dictionary file just disables encoding 2
+    bool loadDictionary(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        dictionary = contents.str();
+        if (dictionary.empty()) return false;
+        dictionaryId = adler32(adler32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(dictionary.data()), dictionary.size());
+        return true;
+    }
+
+    uint32_t currentDictionaryId() const { return dictionaryId; }
+    size_t dictionarySize() const { return dictionary.size(); }
+
+    // offer is the value of the handshake's compress= token
+    Encoding negotiate(int socket, const std::string& offer) {
+        Encoding encoding = Plain;
+        if (offer.compare(0, 7, "deflate") == 0) {
+            encoding = Deflate;
+            size_t colon = offer.find(':');
+            if (colon != std::string::npos && dictionaryId != 0
+                    && strtoul(offer.c_str() + colon + 1, nullptr, 16) == dictionaryId) {
+                encoding = DeflateDictionary;
+            }
+        }
+        std::lock_guard<std::mutex> lock(codecMutex);
+        if (encoding == Plain) {
+            encodings.erase(socket);
+        } else {
+            encodings[socket] = encoding;
+        }
+        return encoding;
+    }
+
+    void clientGone(int socket) {
+        std::lock_guard<std::mutex> lock(codecMutex);
+        encodings.erase(socket);
+    }
+
+    Encoding encodingFor(int socket) {
+        std::lock_guard<std::mutex> lock(codecMutex);
+        auto it = encodings.find(socket);
+        return it == encodings.end() ? Plain : it->second;
+    }
+
+    // Bytes one fan-out would have sent as plain text against what it sent
+    void recordFanout(uint64_t plain, uint64_t sent) {
+        plainBytes += plain;
+        sentBytes += sent;
+    }
+
+    static const char* encodingName(Encoding encoding) {
+        switch (encoding) {
+            case Plain: return "plain";
+            case Deflate: return "deflate";
+            case DeflateDictionary: return "deflate+dictionary";
+        }
+        return "unknown";
+    }
+
+    std::string status() {
+        size_t negotiated[3] = {0, 0, 0};
+        {
+            std::lock_guard<std::mutex> lock(codecMutex);
+            for (const auto& entry : encodings) negotiated[entry.second]++;
+        }
+        char id[16];
+        snprintf(id, sizeof(id), "%08x", dictionaryId);
+
+        uint64_t plain = plainBytes;
+        uint64_t sent = sentBytes;
+        std::ostringstream oss;
+        oss << "{\"dictionary_id\": \"" << (dictionaryId ? id : "") << "\", \"dictionary_bytes\": " << dictionary.size()
+            << ", \"clients_deflate\": " << negotiated[Deflate]
+            << ", \"clients_dictionary\": " << negotiated[DeflateDictionary]
+            << ", \"frames_compressed\": " << framesCompressed << ", \"compress_us\": " << compressMicros
+            << ", \"plain_bytes\": " << plain << ", \"sent_bytes\": " << sent
+            << ", \"saved_bytes\": " << (plain > sent ? plain - sent : 0) << "}";
+        return oss.str();
+    }
+
+private:
+    // Returns the complete ZMSG frame, or "" if it would not be smaller
+    std::string compress(const std::string& plain, Encoding encoding) {
+        auto start = std::chrono::steady_clock::now();
+
+        z_stream stream{};
+        if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) return "";
+        if (encoding == DeflateDictionary) {
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.data()), dictionary.size());
+        }
+
+        std::string body(deflateBound(&stream, plain.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(plain.data()));
+        stream.avail_in = plain.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&body[0]);
+        stream.avail_out = body.size();
+        int result = deflate(&stream, Z_FINISH);
+        body.resize(stream.total_out);
+        deflateEnd(&stream);
+
+        framesCompressed++;
+        compressMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (result != Z_STREAM_END) return "";
+
+        std::string frame = "ZMSG:" + std::to_string(encoding) + ":" + std::to_string(plain.size())
+            + ":" + std::to_string(body.size()) + "\n" + body;
+        return frame.size() < plain.size() ? frame : "";
+    }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+// Versioned view of which clients are online. Every published state change
+// gets a new version, and each client keeps only its latest change, so
+// "changes since N" collapses any number of flaps into one entry per client.
+// Clients that flap are damped like BGP route flap damping: each disconnect
+// adds a penalty that decays with a half-life; above SUPPRESS_PENALTY the
+// published state is frozen until the penalty decays below REUSE_PENALTY.
+class PresenceFeed {
+public:
+    enum class Report { Publish, Damped, Suppressed };
+
+    struct Change {
+        std::string ip;
+        bool online;
+        uint64_t version;
+    };
+
+    struct Released {
+        std::string ip;
+        bool online;
+        uint32_t hiddenTransitions;
+    };
+
+private:
+    static constexpr double FLAP_PENALTY = 1000;
+    static constexpr double SUPPRESS_PENALTY = 3000;
+    static constexpr double REUSE_PENALTY = 750;
+    static constexpr double HALF_LIFE_SECONDS = 60;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+        int sessions = 0;
+        bool published = false;     // online state consumers have seen
+        uint64_t version = 0;       // version of the last published change
+        double penalty = 0;
+        Clock::time_point penaltyUpdated;
+        bool suppressed = false;
+        uint32_t hiddenTransitions = 0;
+    };
+
+    std::map<std::string, State> states;
+    std::map<uint64_t, std::string> byVersion; // latest change per client
+    std::set<std::string> suppressedClients;
+    std::mutex presenceMutex;
+    uint64_t version = 0;
+
+public:
+    Report connected(const std::string& ip) {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        State& state = states[ip];
+        state.sessions++;
+        return transition(ip, state, false);
+    }
+
+    Report disconnected(const std::string& ip) {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        State& state = states[ip];
+        if (state.sessions > 0) state.sessions--;
+        return transition(ip, state, true);
+    }
+
+    // Un-suppresses clients whose penalty has decayed and publishes their
+    // current state. Called periodically and before answering queries.
+    std::vector<Released> releaseDamped() {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        std::vector<Released> released;
+        auto now = Clock::now();
+        for (auto it = suppressedClients.begin(); it != suppressedClients.end();) {
+            State& state = states[*it];
+            if (decay(state, now) >= REUSE_PENALTY) {
+                ++it;
+                continue;
+            }
+
+            state.suppressed = false;
+            released.push_back({*it, state.sessions > 0, state.hiddenTransitions});
+            state.hiddenTransitions = 0;
+            publish(*it, state);
+            it = suppressedClients.erase(it);
+        }
+        return released;
+    }
+
+    uint64_t currentVersion() {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        return version;
+    }
+
+    // Latest published change of every client that changed after since, in
+    // version order. Cost is proportional to the number of changes.
+    std::vector<Change> changesSince(uint64_t since, uint64_t& current, std::vector<std::string>& suppressed) {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        std::vector<Change> changes;
+        for (auto it = byVersion.upper_bound(since); it != byVersion.end(); ++it) {
+            changes.push_back({it->second, states[it->second].published, it->first});
+        }
+        suppressed.assign(suppressedClients.begin(), suppressedClients.end());
+        current = version;
+        return changes;
+    }
+
+private:
+    double decay(State& state, Clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - state.penaltyUpdated).count();
+        state.penalty *= std::pow(0.5, elapsed / HALF_LIFE_SECONDS);
+        state.penaltyUpdated = now;
+        return state.penalty;
+    }
+
+    Report transition(const std::string& ip, State& state, bool flap) {
+        auto now = Clock::now();
+        decay(state, now);
+        if (flap) state.penalty += FLAP_PENALTY;
+
+        if (state.suppressed) {
+            state.hiddenTransitions++;
+            return Report::Damped;
+        }
+        if (state.penalty >= SUPPRESS_PENALTY) {
+            state.suppressed = true;
+            state.hiddenTransitions = 1;
+            suppressedClients.insert(ip);
+            return Report::Suppressed;
+        }
+
+        publish(ip, state);
+        return Report::Publish;
+    }
+
+    void publish(const std::string& ip, State& state) {
+        bool online = state.sessions > 0;
+        if (online == state.published && state.version != 0) return;
+
+        if (state.version != 0) byVersion.erase(state.version);
+        state.published = online;
+        state.version = ++version;
+        byVersion[state.version] = ip;
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+
+// Limits shared by every connection. Stored as atomics so the bridge can
+// change them while client threads read them on each receive.
+struct RateLimitPolicy {
+    enum Action { Drop = 0, Throttle = 1, Disconnect = 2 };
+
+    std::atomic<long> framesPerSecond{20};
+    std::atomic<long> bytesPerSecond{64 * 1024};
+    std::atomic<long> burstSeconds{2};
+    std::atomic<int> action{Throttle};
+
+    // Fleet-wide counters, reported by rate_stats
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> throttleWaits{0};
+    std::atomic<uint64_t> throttledMillis{0};
+    std::atomic<uint64_t> disconnects{0};
+
+    static const char* actionName(int action) {
+        switch (action) {
+            case Drop: return "drop";
+            case Throttle: return "throttle";
+            case Disconnect: return "disconnect";
+        }
+        return "unknown";
+    }
+
+    static int parseAction(const std::string& text) {
+        if (text == "drop") return Drop;
+        if (text == "throttle") return Throttle;
+        if (text == "disconnect") return Disconnect;
+        return -1;
+    }
+};
+
+// Per-connection counters. Written only by the owning client thread, read
+// by rate_stats, hence relaxed atomics rather than a lock.
+struct ClientRateStats {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> throttledMillis{0};
+};
+
+// Token buckets for frames and bytes of one connection. Owned by the client
+// thread so checks take no locks; limits are re-read from the policy on
+// each call so changes apply to live connections.
+class InboundRateLimiter {
+public:
+    enum class Verdict { Accept, Drop, Disconnect };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimitPolicy& policy;
+    ClientRateStats& stats;
+    double frameTokens;
+    double byteTokens;
+    Clock::time_point lastRefill;
+    Clock::time_point lastViolation;
+    bool limited = false;
+
+public:
+    InboundRateLimiter(RateLimitPolicy& p, ClientRateStats& s)
+        : policy(p), stats(s), lastRefill(Clock::now()) {
+        frameTokens = policy.framesPerSecond.load() * policy.burstSeconds.load();
+        byteTokens = policy.bytesPerSecond.load() * policy.burstSeconds.load();
+    }
+
+    // True while the connection is over its limits (until a second passes
+    // without a violation); lets the caller log once per episode.
+    bool isLimited() const { return limited; }
+
+    // Charges one frame of the given size. Throttle sleeps the calling
+    // thread until the buckets refill, which stops reads and lets TCP push
+    // back on the sender.
+    Verdict admit(size_t bytes) {
+        stats.frames.fetch_add(1, std::memory_order_relaxed);
+        stats.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+        refill();
+        if (frameTokens >= 1 && byteTokens >= bytes) {
+            frameTokens -= 1;
+            byteTokens -= bytes;
+            if (limited && lastRefill - lastViolation > std::chrono::seconds(1)) limited = false;
+            return Verdict::Accept;
+        }
+
+        limited = true;
+        lastViolation = lastRefill;
+        switch (policy.action.load(std::memory_order_relaxed)) {
+            case RateLimitPolicy::Drop:
+                stats.dropped.fetch_add(1, std::memory_order_relaxed);
+                policy.framesDropped.fetch_add(1, std::memory_order_relaxed);
+                return Verdict::Drop;
+
+            case RateLimitPolicy::Disconnect:
+                policy.disconnects.fetch_add(1, std::memory_order_relaxed);
+                return Verdict::Disconnect;
+
+            default: {
+                auto waitStart = Clock::now();
+                while (frameTokens < 1 || byteTokens < bytes) {
+                    std::this_thread::sleep_for(deficitDelay(bytes));
+                    refill();
+                }
+                frameTokens -= 1;
+                byteTokens -= bytes;
+
+                uint64_t waited = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - waitStart).count();
+                stats.throttledMillis.fetch_add(waited, std::memory_order_relaxed);
+                policy.throttleWaits.fetch_add(1, std::memory_order_relaxed);
+                policy.throttledMillis.fetch_add(waited, std::memory_order_relaxed);
+                return Verdict::Accept;
+            }
+        }
+    }
+
+private:
+    void refill() {
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+        lastRefill = now;
+
+        double frameRate = std::max(1L, policy.framesPerSecond.load(std::memory_order_relaxed));
+        double byteRate = std::max(1L, policy.bytesPerSecond.load(std::memory_order_relaxed));
+        double burst = std::max(1L, policy.burstSeconds.load(std::memory_order_relaxed));
+
+        frameTokens = std::min(frameRate * burst, frameTokens + elapsed * frameRate);
+        // Frames are single recv() calls of under 1 KB; keep room for one
+        byteTokens = std::min(std::max(byteRate * burst, 1024.0), byteTokens + elapsed * byteRate);
+    }
+
+    std::chrono::milliseconds deficitDelay(size_t bytes) const {
+        double frameRate = std::max(1L, policy.framesPerSecond.load(std::memory_order_relaxed));
+        double byteRate = std::max(1L, policy.bytesPerSecond.load(std::memory_order_relaxed));
+        double seconds = std::max((1 - frameTokens) / frameRate, (bytes - byteTokens) / byteRate);
+        return std::chrono::milliseconds(std::max(1L, std::min(1000L, (long)(seconds * 1000))));
+    }
+};
@@ -0,0 +1,428 @@
+// Replays a traffic journal recorded with "capture start" against a running
+// server and reports latency and throughput, one JSON object per metric:
+//
+//   ./replay <capture.bin> [--host <ip>] [--speed <factor>] [--skip <cmd,cmd>]
+//            [--baseline <previous output>] [--drain <seconds>]
+//
+// Client connections are re-opened from this machine and their frames are
+// re-sent at the recorded offsets divided by --speed. Bridge commands are
+// re-issued per recorded bridge connection, each one waiting for the
+// previous END_RESPONSE like the Java bridge does. "stop" is skipped unless
+// --skip is given. With --baseline, every metric also shows the earlier
+// run's value and the change in percent, so two builds can be compared by
+// replaying the same journal against each.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "traffic_capture.h"
+
+class ReplayDriver {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct ClientConnection {
+        int fd = -1;
+        std::deque<Clock::time_point> pings; // sent, waiting for PONG
+    };
+
+    struct BridgeConnection {
+        int fd = -1;
+        std::deque<std::string> queued;
+        std::string inflight;               // command name, empty when idle
+        Clock::time_point sentAt;
+        std::string received;
+        bool closeWhenIdle = false;
+    };
+
+    const std::vector<TrafficCapture::Record>& records;
+    std::string host;
+    double speed;
+    std::set<std::string> skip;
+    double drainSeconds;
+
+    std::map<uint32_t, ClientConnection> clients;
+    std::map<uint32_t, BridgeConnection> bridges;
+
+    // Samples in microseconds
+    std::vector<double> lateness, connectTimes, pingTimes;
+    std::map<std::string, std::vector<double>> commandTimes;
+    uint64_t connectFailures = 0, framesSent = 0, framesSkipped = 0, commandsSkipped = 0, bridgeFailures = 0;
+    double elapsedSeconds = 0;
+
+public:
+    ReplayDriver(const std::vector<TrafficCapture::Record>& journal, const std::string& h, double s,
+                 const std::set<std::string>& skipped, double drain)
+        : records(journal), host(h), speed(s), skip(skipped), drainSeconds(drain) {}
+
+    void run() {
+        Clock::time_point start = Clock::now();
+        size_t next = 0;
+        while (next < records.size()) {
+            Clock::time_point due = start + std::chrono::microseconds(
+                static_cast<int64_t>(records[next].micros / speed));
+            pollFor(due);
+
+            // Everything already due goes out together
+            Clock::time_point now = Clock::now();
+            while (next < records.size() && start + std::chrono::microseconds(
+                       static_cast<int64_t>(records[next].micros / speed)) <= now) {
+                Clock::time_point recordDue = start + std::chrono::microseconds(
+                    static_cast<int64_t>(records[next].micros / speed));
+                lateness.push_back(micros(now - recordDue));
+                issue(records[next]);
+                next++;
+            }
+        }
+
+        // Let outstanding bridge commands and pongs come back
+        Clock::time_point drainUntil = Clock::now() + std::chrono::milliseconds(static_cast<int64_t>(drainSeconds * 1000));
+        while (Clock::now() < drainUntil && busy()) {
+            pollFor(std::min(drainUntil, Clock::now() + std::chrono::milliseconds(50)));
+        }
+        elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (auto& entry : clients) {
+            if (entry.second.fd >= 0) close(entry.second.fd);
+        }
+        for (auto& entry : bridges) {
+            if (entry.second.fd >= 0) {
+                if (!entry.second.inflight.empty()) bridgeFailures++;
+                bridgeFailures += entry.second.queued.size();
+                close(entry.second.fd);
+            }
+        }
+    }
+
+    // name -> value, in output order
+    std::vector<std::pair<std::string, double>> metrics() {
+        std::vector<std::pair<std::string, double>> result;
+        size_t commands = 0;
+        std::vector<double> allCommands;
+        for (const auto& entry : commandTimes) {
+            commands += entry.second.size();
+            allCommands.insert(allCommands.end(), entry.second.begin(), entry.second.end());
+        }
+
+        result.emplace_back("replay/records", records.size());
+        result.emplace_back("replay/elapsed_ms", elapsedSeconds * 1000);
+        addPercentiles(result, "replay/lateness", lateness);
+        result.emplace_back("client/connects", connectTimes.size());
+        result.emplace_back("client/connect_failures", connectFailures);
+        addPercentiles(result, "client/connect", connectTimes);
+        result.emplace_back("client/frames_per_sec", elapsedSeconds > 0 ? framesSent / elapsedSeconds : 0);
+        result.emplace_back("client/frames_skipped", framesSkipped);
+        addPercentiles(result, "client/ping", pingTimes);
+        result.emplace_back("bridge/commands", commands);
+        result.emplace_back("bridge/commands_per_sec", elapsedSeconds > 0 ? commands / elapsedSeconds : 0);
+        result.emplace_back("bridge/skipped", commandsSkipped);
+        result.emplace_back("bridge/unanswered", bridgeFailures);
+        addPercentiles(result, "bridge/all", allCommands);
+        for (auto& entry : commandTimes) {
+            addPercentiles(result, "bridge/" + entry.first, entry.second);
+        }
+        return result;
+    }
+
+private:
+    static double micros(Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    static void addPercentiles(std::vector<std::pair<std::string, double>>& out, const std::string& name,
+                               std::vector<double>& samples) {
+        if (samples.empty()) return;
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double p) { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+        out.emplace_back(name + "/p50_us", at(0.50));
+        out.emplace_back(name + "/p95_us", at(0.95));
+        out.emplace_back(name + "/p99_us", at(0.99));
+        out.emplace_back(name + "/max_us", samples.back());
+    }
+
+    bool busy() {
+        for (const auto& entry : bridges) {
+            if (entry.second.fd >= 0 && (!entry.second.inflight.empty() || !entry.second.queued.empty())) return true;
+        }
+        for (const auto& entry : clients) {
+            if (entry.second.fd >= 0 && !entry.second.pings.empty()) return true;
+        }
+        return false;
+    }
+
+    int connectTo(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    static size_t countOf(const std::string& text, const char* word) {
+        size_t count = 0;
+        for (size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1)) count++;
+        return count;
+    }
+
+    void issue(const TrafficCapture::Record& record) {
+        switch (record.type) {
+            case TrafficCapture::ClientConnect: {
+                Clock::time_point before = Clock::now();
+                ClientConnection& client = clients[record.connection];
+                client.fd = connectTo(9998);
+                if (client.fd < 0) {
+                    connectFailures++;
+                } else {
+                    connectTimes.push_back(micros(Clock::now() - before));
+                }
+                break;
+            }
+            case TrafficCapture::ClientFrame: {
+                auto it = clients.find(record.connection);
+                if (it == clients.end() || it->second.fd < 0
+                        || send(it->second.fd, record.payload.data(), record.payload.size(), MSG_NOSIGNAL) <= 0) {
+                    framesSkipped++;
+                    break;
+                }
+                framesSent++;
+                for (size_t i = countOf(record.payload, "PING"); i > 0; i--) {
+                    it->second.pings.push_back(Clock::now());
+                }
+                break;
+            }
+            case TrafficCapture::ClientDisconnect: {
+                auto it = clients.find(record.connection);
+                if (it != clients.end()) {
+                    if (it->second.fd >= 0) close(it->second.fd);
+                    clients.erase(it);
+                }
+                break;
+            }
+            case TrafficCapture::BridgeCommand: {
+                std::string name = record.payload.substr(0, record.payload.find(' '));
+                if (skip.count(name)) {
+                    commandsSkipped++;
+                    break;
+                }
+                BridgeConnection& bridge = bridges[record.connection];
+                if (bridge.fd < 0) bridge.fd = connectTo(9999);
+                if (bridge.fd < 0) {
+                    bridgeFailures++;
+                    break;
+                }
+                bridge.queued.push_back(record.payload);
+                sendNext(bridge);
+                break;
+            }
+            case TrafficCapture::BridgeDisconnect: {
+                auto it = bridges.find(record.connection);
+                if (it != bridges.end()) it->second.closeWhenIdle = true;
+                closeIfIdle(record.connection);
+                break;
+            }
+        }
+    }
+
+    void sendNext(BridgeConnection& bridge) {
+        if (!bridge.inflight.empty() || bridge.queued.empty()) return;
+        std::string command = bridge.queued.front();
+        bridge.queued.pop_front();
+        std::string line = command + "\n";
+        if (send(bridge.fd, line.c_str(), line.size(), MSG_NOSIGNAL) <= 0) {
+            bridgeFailures++;
+            return;
+        }
+        bridge.inflight = command.substr(0, command.find(' '));
+        bridge.sentAt = Clock::now();
+    }
+
+    void closeIfIdle(uint32_t connection) {
+        auto it = bridges.find(connection);
+        if (it == bridges.end() || !it->second.closeWhenIdle) return;
+        BridgeConnection& bridge = it->second;
+        if (!bridge.inflight.empty() || !bridge.queued.empty()) return;
+        if (bridge.fd >= 0) close(bridge.fd);
+        bridges.erase(it);
+    }
+
+    // Reads whatever the server sends until deadline
+    void pollFor(Clock::time_point deadline) {
+        do {
+            std::vector<pollfd> fds;
+            std::vector<std::pair<bool, uint32_t>> owners; // is bridge, connection
+            for (const auto& entry : clients) {
+                if (entry.second.fd >= 0) {
+                    fds.push_back({entry.second.fd, POLLIN, 0});
+                    owners.emplace_back(false, entry.first);
+                }
+            }
+            for (const auto& entry : bridges) {
+                if (entry.second.fd >= 0) {
+                    fds.push_back({entry.second.fd, POLLIN, 0});
+                    owners.emplace_back(true, entry.first);
+                }
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            int ready = poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(0, remaining)));
+            if (ready <= 0) continue;
+
+            char buffer[65536];
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                ssize_t n = recv(fds[i].fd, buffer, sizeof(buffer), 0);
+                Clock::time_point now = Clock::now();
+                if (owners[i].first) {
+                    readBridge(owners[i].second, n > 0 ? std::string(buffer, n) : "", n <= 0, now);
+                } else {
+                    readClient(owners[i].second, n > 0 ? std::string(buffer, n) : "", n <= 0, now);
+                }
+            }
+        } while (Clock::now() < deadline);
+    }
+
+    void readClient(uint32_t connection, const std::string& data, bool closed, Clock::time_point now) {
+        ClientConnection& client = clients[connection];
+        if (closed) {
+            // Kicked by the server (kill_switch, rate limit); later frames are skipped
+            close(client.fd);
+            client.fd = -1;
+            client.pings.clear();
+            return;
+        }
+        for (size_t i = countOf(data, "PONG"); i > 0 && !client.pings.empty(); i--) {
+            pingTimes.push_back(micros(now - client.pings.front()));
+            client.pings.pop_front();
+        }
+    }
+
+    void readBridge(uint32_t connection, const std::string& data, bool closed, Clock::time_point now) {
+        BridgeConnection& bridge = bridges[connection];
+        if (closed) {
+            if (!bridge.inflight.empty()) bridgeFailures++;
+            bridgeFailures += bridge.queued.size();
+            close(bridge.fd);
+            bridges.erase(connection);
+            return;
+        }
+        bridge.received += data;
+        size_t end;
+        while ((end = bridge.received.find("END_RESPONSE\n")) != std::string::npos) {
+            bridge.received.erase(0, end + 13);
+            if (!bridge.inflight.empty()) {
+                commandTimes[bridge.inflight].push_back(micros(now - bridge.sentAt));
+                bridge.inflight.clear();
+            }
+            sendNext(bridge);
+        }
+        closeIfIdle(connection);
+    }
+};
+
+// Metric values from an earlier run's output
+static std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        char name[256];
+        double value;
+        if (sscanf(line.c_str(), "{\"metric\": \"%255[^\"]\", \"value\": %lf", name, &value) == 2) {
+            baseline[name] = value;
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char* argv[]) {
+    std::string journal, host = "127.0.0.1", baselinePath;
+    double speed = 1, drain = 10;
+    std::set<std::string> skip = {"stop"};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc) {
+            host = argv[++i];
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (arg == "--skip" && i + 1 < argc) {
+            skip.clear();
+            std::istringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) skip.insert(name);
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--drain" && i + 1 < argc) {
+            drain = atof(argv[++i]);
+        } else if (journal.empty() && arg[0] != '-') {
+            journal = arg;
+        } else {
+            journal.clear();
+            break;
+        }
+    }
+    if (journal.empty() || speed <= 0) {
+        std::cerr << "Usage: " << argv[0] << " <capture.bin> [--host <ip>] [--speed <factor>] [--skip <cmd,cmd>]"
+                  << " [--baseline <previous output>] [--drain <seconds>]" << std::endl;
+        return 1;
+    }
+
+    std::vector<TrafficCapture::Record> records;
+    if (!TrafficCapture::read(journal, records)) {
+        std::cerr << "Journal " << journal << " is unreadable or truncated, replaying " << records.size()
+                  << " complete records" << std::endl;
+        if (records.empty()) return 1;
+    }
+
+    // A reconnect storm needs one descriptor per recorded client
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    ReplayDriver driver(records, host, speed, skip, drain);
+    driver.run();
+
+    std::map<std::string, double> baseline;
+    if (!baselinePath.empty()) baseline = readBaseline(baselinePath);
+    for (const auto& metric : driver.metrics()) {
+        std::cout << "{\"metric\": \"" << metric.first << "\", \"value\": " << static_cast<uint64_t>(metric.second + 0.5);
+        auto it = baseline.find(metric.first);
+        if (it != baseline.end()) {
+            std::cout << ", \"baseline\": " << static_cast<uint64_t>(it->second + 0.5);
+            if (it->second > 0) {
+                char delta[32];
+                snprintf(delta, sizeof(delta), "%+.1f", (metric.second - it->second) * 100 / it->second);
+                std::cout << ", \"delta_pct\": " << delta;
+            }
+        }
+        std::cout << "}" << std::endl;
+    }
+    return 0;
+}
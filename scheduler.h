@@ -0,0 +1,412 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <mutex>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+// Holds pending announcements in a min-heap keyed by due time. The owner
+// waits until nextDue() and collects due jobs with takeDue(); the wakeup
+// callback tells it when an added job may be due sooner.
+//
+// Persistent jobs survive restarts through SCHEDULE_FILE, an append-only log
+// of job lines and "-<id>" removals. It is rewritten with only the live jobs
+// once it holds max(MIN_COMPACT_RECORDS, 2 * live jobs) lines.
+class MessageScheduler {
+public:
+    enum class Kind { Once, Interval, Daily, Weekly };
+    enum class CancelResult { Cancelled, NotFound, BuiltIn };
+
+    static const size_t MIN_COMPACT_RECORDS = 1024;
+    static const long MAX_DURATION = 366 * 86400; // seconds; keeps due times representable
+
+    struct Job {
+        uint64_t id;
+        Kind kind;
+        time_t nextRun;
+        long interval;      // seconds, Interval jobs only
+        int weekday;        // 0 = Sunday, Weekly jobs only
+        int minuteOfDay;    // Daily and Weekly jobs
+        bool persistent;
+        std::string message;
+    };
+
+    using WakeupCallback = std::function<void()>;
+
+private:
+    struct HeapEntry {
+        time_t when;
+        uint64_t id;
+        bool operator>(const HeapEntry& other) const {
+            return when != other.when ? when > other.when : id > other.id;
+        }
+    };
+
+    // Jobs are looked up by id; heap entries whose time no longer matches the
+    // job (rescheduled or cancelled) are skipped when popped.
+    std::map<uint64_t, Job> jobs;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+    std::mutex jobsMutex;
+    uint64_t nextId = 1;
+    std::string storePath;
+    std::ofstream store;
+    size_t storeRecords = 0;   // lines in the store file
+    size_t persistentJobs = 0;
+    WakeupCallback onWakeup;
+
+public:
+    explicit MessageScheduler(const std::string& path) : storePath(path) {}
+
+    void setWakeup(WakeupCallback callback) { onWakeup = std::move(callback); }
+
+    // Overdue one-shot jobs keep their time and fire right away; overdue
+    // recurring jobs fire once and then resume their schedule.
+    void load() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::ifstream in(storePath);
+        std::string line;
+        while (std::getline(in, line)) {
+            storeRecords++;
+            if (!line.empty() && line[0] == '-') {
+                jobs.erase(strtoull(line.c_str() + 1, nullptr, 10));
+                continue;
+            }
+            std::istringstream fields(line);
+            Job job{};
+            int kind;
+            if (!(fields >> job.id >> kind >> job.nextRun >> job.interval >> job.weekday >> job.minuteOfDay)) continue;
+            if (kind < 0 || kind > static_cast<int>(Kind::Weekly)) continue;
+            job.kind = static_cast<Kind>(kind);
+            if (!validStored(job, time(nullptr))) continue;
+            fields.get(); // tab before message
+            std::string message;
+            std::getline(fields, message);
+            job.persistent = true;
+            job.message = unescapeField(message);
+            jobs[job.id] = job;
+            heap.push({job.nextRun, job.id});
+            nextId = std::max(nextId, job.id + 1);
+        }
+        in.close();
+        persistentJobs = jobs.size();
+        if (storeRecords > persistentJobs) compact();
+    }
+
+    uint64_t add(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            job.id = nextId++;
+            jobs[job.id] = job;
+            heap.push({job.nextRun, job.id});
+            if (job.persistent) {
+                persistentJobs++;
+                append(job);
+            }
+        }
+        if (onWakeup) onWakeup();
+        return job.id;
+    }
+
+    // Due time of the earliest job, 0 if there is none
+    time_t nextDue() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        dropStale();
+        return heap.empty() ? 0 : heap.top().when;
+    }
+
+    // Removes every job due at now and returns them in due order. One-shot
+    // jobs are gone afterwards; recurring ones move to their next run.
+    // Overdue recurring jobs come back once and then resume their schedule.
+    std::vector<Job> takeDue(time_t now) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::vector<Job> due;
+        while (!heap.empty()) {
+            dropStale();
+            if (heap.empty() || heap.top().when > now) break;
+
+            auto it = jobs.find(heap.top().id);
+            heap.pop();
+            Job job = it->second;
+            if (job.kind == Kind::Once) {
+                jobs.erase(it);
+                if (job.persistent) {
+                    persistentJobs--;
+                    appendRemoval(job.id);
+                }
+            } else {
+                it->second.nextRun = nextOccurrence(job, now);
+                heap.push({it->second.nextRun, job.id});
+                if (job.persistent) append(it->second);
+            }
+            due.push_back(job);
+        }
+        return due;
+    }
+
+    // Built-in (non-persistent) jobs are re-added on every start and cannot
+    // be cancelled.
+    CancelResult cancel(uint64_t id) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) return CancelResult::NotFound;
+        if (!it->second.persistent) return CancelResult::BuiltIn;
+        jobs.erase(it);
+        persistentJobs--;
+        appendRemoval(id);
+        return CancelResult::Cancelled;
+    }
+
+    std::vector<Job> list() {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::vector<Job> result;
+        result.reserve(jobs.size());
+        for (const auto& entry : jobs) result.push_back(entry.second);
+        std::sort(result.begin(), result.end(),
+            [](const Job& a, const Job& b) { return a.nextRun < b.nextRun; });
+        return result;
+    }
+
+    // Parses "at HH:MM", "in <dur>", "every <dur>", "every day HH:MM" and
+    // "every <weekday> [HH:MM]" from the stream into job. Durations take an
+    // s/m/h/d suffix ("10m") and are at most 366 days. Returns false on
+    // malformed input.
+    static bool parseWhen(std::istringstream& iss, Job& job, time_t now) {
+        std::string word;
+        if (!(iss >> word)) return false;
+
+        if (word == "at") {
+            std::string clock;
+            if (!(iss >> clock) || !parseClock(clock, job.minuteOfDay)) return false;
+            job.kind = Kind::Once;
+            job.nextRun = nextDaily(now, job.minuteOfDay);
+            return true;
+        }
+        if (word == "in") {
+            std::string duration;
+            if (!(iss >> duration) || !parseDuration(duration, job.interval)) return false;
+            job.kind = Kind::Once;
+            job.nextRun = now + job.interval;
+            job.interval = 0;
+            return true;
+        }
+        if (word != "every") return false;
+
+        std::string what;
+        if (!(iss >> what)) return false;
+        std::transform(what.begin(), what.end(), what.begin(), ::tolower);
+
+        if (parseDuration(what, job.interval)) {
+            job.kind = Kind::Interval;
+            job.nextRun = now + job.interval;
+            return true;
+        }
+
+        job.minuteOfDay = 0;
+        std::streampos beforeClock = iss.tellg();
+        std::string clock;
+        if (iss >> clock) {
+            if (!parseClock(clock, job.minuteOfDay)) {
+                iss.clear();
+                iss.seekg(beforeClock); // not a time, it is part of the message
+            }
+        }
+
+        if (what == "day") {
+            job.kind = Kind::Daily;
+            job.nextRun = nextDaily(now, job.minuteOfDay);
+            return true;
+        }
+        job.weekday = parseWeekday(what);
+        if (job.weekday < 0) return false;
+        job.kind = Kind::Weekly;
+        job.nextRun = nextWeekly(now, job.weekday, job.minuteOfDay);
+        return true;
+    }
+
+    static std::string describe(const Job& job) {
+        static const char* days[] = {"sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday"};
+        char clock[16];
+        snprintf(clock, sizeof(clock), "%02d:%02d", job.minuteOfDay / 60, job.minuteOfDay % 60);
+        switch (job.kind) {
+            case Kind::Once: return "once";
+            case Kind::Interval: return "every " + std::to_string(job.interval) + "s";
+            case Kind::Daily: return std::string("every day ") + clock;
+            case Kind::Weekly: return std::string("every ") + days[job.weekday] + " " + clock;
+        }
+        return "";
+    }
+
+private:
+    // Pops heap entries whose time no longer matches their job (rescheduled
+    // or cancelled). Caller holds jobsMutex.
+    void dropStale() {
+        while (!heap.empty()) {
+            auto it = jobs.find(heap.top().id);
+            if (it != jobs.end() && it->second.nextRun == heap.top().when) return;
+            heap.pop();
+        }
+    }
+
+    static time_t nextOccurrence(const Job& job, time_t now) {
+        switch (job.kind) {
+            case Kind::Interval: return now + job.interval;
+            case Kind::Daily: return nextDaily(now, job.minuteOfDay);
+            case Kind::Weekly: return nextWeekly(now, job.weekday, job.minuteOfDay);
+            case Kind::Once: break;
+        }
+        return now;
+    }
+
+    static time_t nextDaily(time_t now, int minuteOfDay) {
+        return nextWeekly(now, -1, minuteOfDay);
+    }
+
+    // weekday < 0 means any day. mktime normalises day overflow and DST.
+    static time_t nextWeekly(time_t now, int weekday, int minuteOfDay) {
+        struct tm tm = *std::localtime(&now);
+        tm.tm_hour = minuteOfDay / 60;
+        tm.tm_min = minuteOfDay % 60;
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        if (weekday >= 0) tm.tm_mday += (weekday - tm.tm_wday + 7) % 7;
+
+        time_t candidate = mktime(&tm);
+        if (candidate <= now) {
+            tm.tm_mday += weekday >= 0 ? 7 : 1;
+            tm.tm_isdst = -1;
+            candidate = mktime(&tm);
+        }
+        return candidate;
+    }
+
+    static bool parseClock(const std::string& text, int& minuteOfDay) {
+        int hours, minutes;
+        char colon;
+        std::istringstream iss(text);
+        if (!(iss >> hours >> colon >> minutes) || colon != ':' || !iss.eof()) return false;
+        if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) return false;
+        minuteOfDay = hours * 60 + minutes;
+        return true;
+    }
+
+    static bool parseDuration(const std::string& text, long& seconds) {
+        if (text.size() < 2 || !isdigit((unsigned char)text[0])) return false;
+        size_t used = 0;
+        long value;
+        try {
+            value = std::stol(text, &used);
+        } catch (...) {
+            return false;
+        }
+        if (used != text.size() - 1 || value <= 0) return false;
+        long unit;
+        switch (text.back()) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            default: return false;
+        }
+        if (value > MAX_DURATION / unit) return false;
+        seconds = value * unit;
+        return true;
+    }
+
+    // A store line written by a broken or older build must not produce a
+    // due time localtime() cannot represent or an interval that never
+    // advances
+    static bool validStored(const Job& job, time_t now) {
+        if (job.nextRun < 0 || job.nextRun > now + MAX_DURATION) return false;
+        if (job.minuteOfDay < 0 || job.minuteOfDay >= 24 * 60) return false;
+        if (job.kind == Kind::Interval && (job.interval <= 0 || job.interval > MAX_DURATION)) return false;
+        if (job.kind == Kind::Weekly && (job.weekday < 0 || job.weekday > 6)) return false;
+        return true;
+    }
+
+    // Full day name or its three-letter abbreviation
+    static int parseWeekday(const std::string& text) {
+        static const char* days[] = {"sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday"};
+        for (int i = 0; i < 7; i++) {
+            if (text == days[i] || text == std::string(days[i], 3)) return i;
+        }
+        return -1;
+    }
+
+    static std::string escapeField(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '\\') out += "\\\\";
+            else if (c == '\n') out += "\\n";
+            else if (c == '\t') out += "\\t";
+            else out += c;
+        }
+        return out;
+    }
+
+    static std::string unescapeField(const std::string& text) {
+        std::string out;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '\\' && i + 1 < text.size()) {
+                char next = text[++i];
+                out += next == 'n' ? '\n' : next == 't' ? '\t' : next;
+            } else {
+                out += text[i];
+            }
+        }
+        return out;
+    }
+
+    static std::string jobLine(const Job& job) {
+        std::ostringstream out;
+        out << job.id << '\t' << static_cast<int>(job.kind) << '\t' << job.nextRun << '\t'
+            << job.interval << '\t' << job.weekday << '\t' << job.minuteOfDay << '\t'
+            << escapeField(job.message) << '\n';
+        return out.str();
+    }
+
+    // A job line adds or replaces that job. Caller holds jobsMutex.
+    void append(const Job& job) {
+        writeRecord(jobLine(job));
+    }
+
+    void appendRemoval(uint64_t id) {
+        writeRecord("-" + std::to_string(id) + "\n");
+    }
+
+    void writeRecord(const std::string& record) {
+        if (storeRecords >= std::max(MIN_COMPACT_RECORDS, 2 * persistentJobs)) {
+            compact(); // the live jobs already include this change
+            return;
+        }
+        if (!store.is_open()) store.open(storePath, std::ios::app);
+        store << record;
+        store.flush();
+        storeRecords++;
+    }
+
+    // Rewrites the store with one line per persistent job. Written to a temp
+    // file and renamed so a crash mid-write never leaves a truncated store.
+    // Caller holds jobsMutex.
+    void compact() {
+        std::string tmpPath = storePath + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            if (!out.is_open()) return;
+            for (const auto& entry : jobs) {
+                if (entry.second.persistent) out << jobLine(entry.second);
+            }
+        }
+        store.close();
+        rename(tmpPath.c_str(), storePath.c_str());
+        storeRecords = persistentJobs;
+    }
+};
@@ -0,0 +1,305 @@
+// Microbenchmarks for ServerManager internals. Prints one JSON object per
+// benchmark so runs can be diffed between builds:
+//
+//   ./server_bench [--filter <substring>] [--min-time <seconds>]
+//
+// Runs inside a fresh temporary directory so server.log and the registry
+// files it writes never touch a real deployment.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "server_manager.h"
+
+class ServerBench {
+private:
+    std::string filter;
+    double minSeconds = 0.3;
+
+    // Keeps the optimiser from discarding benchmarked results
+    size_t sink = 0;
+
+public:
+    ServerBench(const std::string& f, double seconds) : filter(f), minSeconds(seconds) {}
+
+    void runAll() {
+        benchCommands();
+        benchJson();
+        for (size_t count : {1000, 10000, 100000}) {
+            benchRegistry(count);
+        }
+        benchLogging();
+        for (size_t count : {1000, 10000}) {
+            benchQuery(count);
+        }
+        for (size_t count : {100, 1000}) {
+            benchFanout(count);
+        }
+        std::cerr << "checksum: " << sink << std::endl;
+    }
+
+private:
+    // Repeats fn in doubling batches until minSeconds have elapsed and
+    // reports the mean cost of one call.
+    void run(const std::string& name, const std::function<void()>& fn, size_t itemsPerCall = 1) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+        using Clock = std::chrono::steady_clock;
+        fn(); // warm up
+
+        uint64_t iterations = 0;
+        uint64_t batch = 1;
+        double elapsed = 0;
+        while (elapsed < minSeconds) {
+            auto start = Clock::now();
+            for (uint64_t i = 0; i < batch; i++) fn();
+            elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+            iterations += batch;
+            batch *= 2;
+        }
+
+        double nsPerCall = elapsed * 1e9 / iterations;
+        double itemsPerSecond = iterations * itemsPerCall / elapsed;
+        std::cout << "{\"benchmark\": \"" << name << "\", \"iterations\": " << iterations
+                  << ", \"ns_per_op\": " << static_cast<uint64_t>(nsPerCall)
+                  << ", \"items_per_sec\": " << static_cast<uint64_t>(itemsPerSecond) << "}" << std::endl;
+    }
+
+    static std::string fakeIp(size_t i) {
+        return "10." + std::to_string((i >> 16) & 0xff) + "." + std::to_string((i >> 8) & 0xff) + "."
+            + std::to_string(i & 0xff);
+    }
+
+    // Registers count clients with made-up socket numbers; nothing here
+    // sends to or closes them.
+    static void addFakeClients(ServerManager& server, size_t count) {
+        server.clients.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            server.clients.emplace_back(100000 + (int)i, fakeIp(i), std::make_shared<ClientRateStats>());
+        }
+    }
+
+    void benchCommands() {
+        ServerManager server;
+        server.logToConsole = false;
+
+        run("command/help", [&] { sink += server.processCommand("help").size(); });
+        run("command/unknown", [&] { sink += server.processCommand("no_such_command arg").size(); });
+        run("command/rate_limit_query", [&] { sink += server.processCommand("rate_limit").size(); });
+        run("command/message_single_miss", [&] {
+            sink += server.processCommand("message_single 192.168.0.1 hello there").size();
+        });
+    }
+
+    void benchJson() {
+        ServerManager server;
+        std::string message(200, 'x');
+        message[50] = '"';
+        message[120] = '\n';
+        run("json/escape_200b", [&] { sink += server.escapeJson(message).size(); });
+
+        for (size_t count : {1000, 10000, 100000}) {
+            ServerManager populated;
+            addFakeClients(populated, count);
+            run("json/show_ips/" + std::to_string(count), [&] { sink += populated.showConnectedIPs().size(); }, count);
+        }
+    }
+
+    void benchRegistry(size_t count) {
+        std::string suffix = "/" + std::to_string(count);
+        ServerManager server;
+        server.logToConsole = false;
+        addFakeClients(server, count);
+
+        // Ping bookkeeping: handleClient looks the sender up on every frame
+        int middleSocket = 100000 + (int)(count / 2);
+        int lastSocket = 100000 + (int)(count - 1);
+        run("registry/touch_middle" + suffix, [&] { server.touchClient(middleSocket); });
+        run("registry/touch_last" + suffix, [&] { server.touchClient(lastSocket); });
+
+        run("registry/prune_none_stale" + suffix, [&] {
+            std::vector<std::pair<std::string, time_t>> lastSeen;
+            server.pruneStaleClients(time(nullptr), lastSeen);
+            sink += lastSeen.size();
+        }, count);
+
+        // Persistent registry: connect/disconnect append to the delta log
+        server.registry.load();
+        for (size_t i = 0; i < count; i++) {
+            server.registry.connected(fakeIp(i), time(nullptr));
+        }
+        size_t next = 0;
+        run("registry/connect_disconnect" + suffix, [&] {
+            std::string ip = fakeIp(next++ % count);
+            server.registry.disconnected(ip, time(nullptr));
+            server.registry.connected(ip, time(nullptr));
+        });
+        std::vector<std::pair<std::string, time_t>> seen;
+        for (size_t i = 0; i < count; i++) {
+            seen.push_back({fakeIp(i), 0});
+        }
+        time_t seenAt = time(nullptr);
+        run("registry/compact" + suffix, [&] {
+            // Newer last-seen times dirty every entry so each compact writes
+            for (auto& item : seen) item.second = seenAt;
+            seenAt++;
+            server.registry.updateLastSeen(seen);
+            sink += server.registry.compact();
+        }, count);
+
+        // Presence: one flap published, then an incremental query
+        for (size_t i = 0; i < count; i++) {
+            server.presence.connected(fakeIp(i));
+        }
+        run("presence/show_ips_since_recent" + suffix, [&] {
+            uint64_t version = server.presence.currentVersion();
+            sink += server.presenceSince(version > 10 ? version - 10 : 0).size();
+        });
+    }
+
+    void benchLogging() {
+        ServerManager server;
+        server.logToConsole = false;
+        std::string message = "Received from 10.0.0.1: status report with a moderately long body";
+
+        run("log/format", [&] { sink += server.formatLogEntry(message).size(); });
+        run("log/write", [&] { server.logMessage(message); });
+    }
+
+    // Folding answers into a fleet query aggregate, as client threads do
+    void benchQuery(size_t count) {
+        std::string suffix = "/" + std::to_string(count);
+        ServerManager server;
+        std::vector<FleetQueries::Target> targets;
+        for (size_t i = 0; i < count; i++) {
+            targets.push_back({100000 + (int)i, fakeIp(i)});
+        }
+        static const char* versions[] = {"Windows 10 Pro (build 19045)", "Windows 11 Pro (build 22631)",
+                                         "Windows 11 Enterprise (build 26100)"};
+
+        run("query/aggregate_os" + suffix, [&] {
+            auto query = server.queries.start(*FleetQueries::findKind("os"), targets);
+            std::string prefix = std::to_string(query->queryId()) + ":";
+            for (size_t i = 0; i < count; i++) {
+                server.queries.answer(100000 + (int)i, prefix + versions[i % 3]);
+            }
+            sink += query->json(true).size();
+            server.queries.finish(query->queryId());
+        }, count);
+        run("query/aggregate_uptime" + suffix, [&] {
+            auto query = server.queries.start(*FleetQueries::findKind("uptime"), targets);
+            std::string prefix = std::to_string(query->queryId()) + ":";
+            for (size_t i = 0; i < count; i++) {
+                server.queries.answer(100000 + (int)i, prefix + std::to_string(i * 97));
+            }
+            sink += query->json(true).size();
+            server.queries.finish(query->queryId());
+        }, count);
+    }
+
+    // Real socket pairs so send() does the same work as for live clients.
+    // Peers are drained after each broadcast to keep buffers from filling.
+    // A tenth of the clients subscribe to a topic for the publish case;
+    // the 2 KB cases run once as plain text and once with every client
+    // negotiating deflate.
+    void benchFanout(size_t count) {
+        std::string suffix = "/" + std::to_string(count);
+        std::string name = "fanout/message_all" + suffix;
+        std::string publishName = "fanout/publish_10pct" + suffix;
+        std::string largeName = "fanout/message_all_2k" + suffix;
+        std::string deflateName = "fanout/message_all_2k_deflate" + suffix;
+        if (!filter.empty() && (name + publishName + largeName + deflateName).find(filter) == std::string::npos) return;
+
+        ServerManager server;
+        server.logToConsole = false;
+        std::vector<int> peers;
+        for (size_t i = 0; i < count; i++) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+                std::cerr << "socketpair failed after " << i << " clients, skipping " << name << std::endl;
+                for (int fd : peers) close(fd);
+                for (auto& client : server.clients) close(client.socket);
+                return;
+            }
+            fcntl(pair[1], F_SETFL, O_NONBLOCK);
+            server.clients.emplace_back(pair[0], fakeIp(i), std::make_shared<ClientRateStats>());
+            if (i % 10 == 0) server.topics.subscribe(pair[0], fakeIp(i), "finance");
+            peers.push_back(pair[1]);
+        }
+
+        std::string announcement = "Scheduled maintenance tonight at 22:00, please save your work.";
+        char drain[4096];
+        run(name, [&] {
+            sink += server.sendMessageToClients(announcement).size();
+            for (int fd : peers) {
+                while (read(fd, drain, sizeof(drain)) > 0) {}
+            }
+        }, count);
+        run(publishName, [&] {
+            sink += server.publish("finance", announcement).size();
+            for (size_t i = 0; i < peers.size(); i += 10) {
+                while (read(peers[i], drain, sizeof(drain)) > 0) {}
+            }
+        }, count / 10);
+
+        std::string config;
+        for (int i = 0; config.size() < 2048; i++) {
+            config += "policy." + std::to_string(i) + ".enabled=true; policy." + std::to_string(i) + ".interval=300; ";
+        }
+        auto broadcastConfig = [&] {
+            sink += server.sendMessageToClients(config).size();
+            for (int fd : peers) {
+                while (read(fd, drain, sizeof(drain)) > 0) {}
+            }
+        };
+        run(largeName, broadcastConfig, count);
+        for (auto& client : server.clients) server.codec.negotiate(client.socket, "deflate");
+        run(deflateName, broadcastConfig, count);
+
+        for (int fd : peers) close(fd);
+        for (auto& client : server.clients) close(client.socket);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    double minSeconds = 0.3;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minSeconds = atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--filter <substring>] [--min-time <seconds>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // The 1000-client fan-out needs two descriptors per client
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    char dir[] = "/tmp/server_bench.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        std::cerr << "Failed to create working directory" << std::endl;
+        return 1;
+    }
+    std::cerr << "Working directory: " << dir << std::endl;
+
+    ServerBench bench(filter, minSeconds);
+    bench.runAll();
+    return 0;
+}
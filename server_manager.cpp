@@ -0,0 +1,1320 @@
+#include "server_manager.h"
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+std::string ServerManager::sendMessageToClient(const std::string& targetIp, const std::string& message) {
+    TraceRecorder::mark("fanout_start");
+    PayloadCodec::Frame frame(codec, "MSG:" + message);
+    std::vector<Recipient> target;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& client : clients) {
+            if (client.connected && client.ip == targetIp) {
+                target.push_back(recipient(client.socket, client.ip, frame));
+                break;
+            }
+        }
+    }
+    if (target.empty()) {
+        return "{\"error\": \"Client " + targetIp + " not found or not connected\"}";
+    }
+    
+    bool sent = deliver("message_single", target, CLIENT_WRITE_TIMEOUT)[0].ok;
+    TraceRecorder::mark("fanout_finish");
+    if (!sent) {
+        logMessage("Failed to send to " + targetIp);
+        return "{\"error\": \"Failed to send to " + targetIp + "\"}";
+    }
+    codec.recordFanout(frame.text().size(), target[0].payload->size());
+    logMessage("Send to " + targetIp + " {\"" + message + "\"}");
+    return "{\"sent_to\": \"" + targetIp + "\", \"status\": \"success\"}";
+}
+
+ServerManager::ServerManager() : serverSocket(-1), javaSocket(-1), running(false), logToConsole(true),
+      scheduler(SCHEDULE_FILE), uploads(UPLOAD_DIR), registry(REGISTRY_SNAPSHOT, REGISTRY_LOG),
+      capture(CAPTURE_DIR), runtime(TASK_WORKERS) {
+    uploads.setLogger([this](const std::string& message) { logMessage(message); });
+}
+
+void ServerManager::start() {
+    running = true;
+    
+    // Setup signal handlers
+    signal(SIGINT, [](int) { exit(0); });
+    
+    // Restore known clients from the last run before accepting anyone
+    auto loadStart = std::chrono::steady_clock::now();
+    size_t knownClients = registry.load();
+    auto loadMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - loadStart).count();
+    registry.compact();
+    logMessage("Restored " + std::to_string(knownClients) + " known clients from registry in "
+        + std::to_string(loadMicros) + " us");
+    
+    if (codec.loadDictionary(PAYLOAD_DICTIONARY)) {
+        logMessage("Loaded compression dictionary " + PAYLOAD_DICTIONARY + " ("
+            + std::to_string(codec.dictionarySize()) + " bytes)");
+    }
+    
+    // Start client server
+    std::thread clientThread(&ServerManager::clientServerLoop, this);
+    clientThread.detach();
+    
+    // Start Java bridge server
+    std::thread javaThread(&ServerManager::javaBridgeLoop, this);
+    javaThread.detach();
+    
+    // Ping monitoring runs as a periodic task on the runtime's pool
+    runtime.spawn<void>("ping_monitor", [this](CancelToken token) { return monitorPings(token); });
+    
+    // Queued announcements and the auto-update broadcast fire from a task
+    scheduler.load();
+    scheduler.setWakeup([this] { wakeScheduler(); });
+    runtime.spawn<void>("scheduler", [this](CancelToken token) { return runScheduler(token); });
+    scheduleAutoUpdateBroadcast();
+    
+    // Command line interface
+    std::string command;
+    std::cout << "Server started. Available commands:\n";
+    std::cout << "- message <text>: Send message to all clients\n";
+    std::cout << "- publish <topic> <text>: Send message to a topic's subscribers\n";
+    std::cout << "- subscribe|unsubscribe <ip> <topic>: Change a client's topics\n";
+    std::cout << "- topics [<topic>]: Show topics with counters, or one topic's subscribers\n";
+    std::cout << "- compression: Show compressed delivery settings and bytes saved\n";
+    std::cout << "- capture [start [<file>] | stop]: Record client and bridge traffic for replay\n";
+    std::cout << "- tasks [cancel <id>]: Show running tasks and write queues, or cancel a task\n";
+    std::cout << "- query_all <kind> [topic=<name> | ip=<a,b>] [timeout=<s>]: Ask clients for os, build, hostname, uptime or disk_free\n";
+    std::cout << "- show_ips [since=<version>]: Display connected clients, or presence changes since a version\n";
+    std::cout << "- schedule <when> <text>: Queue a message (at 08:00, in 10m, every monday 08:00)\n";
+    std::cout << "- list_scheduled: Show pending scheduled messages\n";
+    std::cout << "- cancel <id>: Remove a scheduled message\n";
+    std::cout << "- request_upload <ip> <name>: Fetch a file (e.g. log) from a client\n";
+    std::cout << "- list_uploads: Show transfers in progress\n";
+    std::cout << "- rate_limit [<frames/s> <bytes/s> <drop|throttle|disconnect>]: Show or set inbound limits\n";
+    std::cout << "- rate_stats: Show rate limit counters\n";
+    std::cout << "- offline_since [seconds]: Known clients offline at least that long\n";
+    std::cout << "- trace [<id> | chrome [<id>]]: Show sampled request latency traces\n";
+    std::cout << "- trace_report <id> <stage>=<ns>...: Add bridge-side stages to a trace (sent by the Java bridge)\n";
+    std::cout << "- kill_switch: Disconnect all clients\n";
+    std::cout << "- stop: Shutdown server\n";
+    std::cout << "- help: Show commands\n\n";
+    
+    while (running) {
+        std::cout << "> ";
+        std::getline(std::cin, command);
+        processCommand(command);
+    }
+}
+
+void ServerManager::clientServerLoop() {
+    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverSocket < 0) {
+        logMessage("Failed to create client socket");
+        return;
+    }
+    
+    int opt = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(CLIENT_PORT);
+    
+    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        logMessage("Failed to bind client socket to port " + std::to_string(CLIENT_PORT));
+        return;
+    }
+    
+    if (listen(serverSocket, 10) < 0) {
+        logMessage("Failed to listen on client socket");
+        return;
+    }
+    
+    logMessage("Client server listening on port " + std::to_string(CLIENT_PORT));
+    
+    while (running) {
+        sockaddr_in clientAddr{};
+        socklen_t clientLen = sizeof(clientAddr);
+        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
+        
+        if (clientSocket >= 0) {
+            std::string clientIP = inet_ntoa(clientAddr.sin_addr);
+            auto rateStats = std::make_shared<ClientRateStats>();
+            auto channel = std::make_shared<TaskRuntime::Channel>(clientSocket);
+            
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                clients.emplace_back(clientSocket, clientIP, rateStats);
+                channels[clientSocket] = channel;
+                capture.clientConnected(clientSocket, clientIP);
+            }
+            
+            ClientRegistry::Entry previous = registry.connected(clientIP, time(nullptr));
+            PresenceFeed::Report report = presence.connected(clientIP);
+            if (report != PresenceFeed::Report::Publish) {
+                logPresenceDamping(clientIP, report);
+            } else if (previous.firstSeen == 0) {
+                logMessage("Client connected from " + clientIP + " (new)");
+            } else if (previous.sessions == 0) {
+                logMessage("Client connected from " + clientIP + " (known, offline since "
+                    + formatTime(previous.lastSeen) + ")");
+            } else {
+                logMessage("Client connected from " + clientIP);
+            }
+            
+            // Handle client in separate thread
+            std::thread clientHandler(&ServerManager::handleClient, this, clientSocket, clientIP, rateStats, channel);
+            clientHandler.detach();
+        }
+    }
+}
+
+void ServerManager::javaBridgeLoop() {
+    javaSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (javaSocket < 0) {
+        logMessage("Failed to create Java bridge socket");
+        return;
+    }
+    
+    int opt = 1;
+    setsockopt(javaSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    sockaddr_in javaAddr{};
+    javaAddr.sin_family = AF_INET;
+    javaAddr.sin_addr.s_addr = INADDR_ANY;
+    javaAddr.sin_port = htons(JAVA_PORT);
+    
+    if (bind(javaSocket, (struct sockaddr*)&javaAddr, sizeof(javaAddr)) < 0) {
+        logMessage("Failed to bind Java bridge socket to port " + std::to_string(JAVA_PORT));
+        return;
+    }
+    
+    if (listen(javaSocket, 5) < 0) {
+        logMessage("Failed to listen on Java bridge socket");
+        return;
+    }
+    
+    logMessage("Java bridge listening on port " + std::to_string(JAVA_PORT));
+    
+    while (running) {
+        sockaddr_in javaClientAddr{};
+        socklen_t javaClientLen = sizeof(javaClientAddr);
+        int javaClientSocket = accept(javaSocket, (struct sockaddr*)&javaClientAddr, &javaClientLen);
+        
+        if (javaClientSocket >= 0) {
+            logMessage("Java bridge connected");
+            
+            // Handle Java bridge communication
+            std::thread javaHandler(&ServerManager::handleJavaBridge, this, javaClientSocket);
+            javaHandler.detach();
+        }
+    }
+}
+
+void ServerManager::handleClient(int clientSocket, const std::string& clientIP, std::shared_ptr<ClientRateStats> rateStats,
+                                 std::shared_ptr<TaskRuntime::Channel> channel) {
+    char buffer[1024];
+    InboundRateLimiter limiter(ratePolicy, *rateStats);
+    std::string buffered; // received bytes not yet forming a whole frame
+    UploadManager::Sender reply = [this, channel](const std::string& frame) {
+        runtime.write(channel, std::make_shared<const std::string>(frame), CLIENT_WRITE_TIMEOUT);
+        return true;
+    };
+    
+    while (running) {
+        memset(buffer, 0, sizeof(buffer));
+        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        
+        if (bytesReceived <= 0) {
+            break; // Client disconnected
+        }
+        
+        buffered.append(buffer, bytesReceived);
+        capture.clientFrame(clientSocket, buffer, bytesReceived);
+        
+        // Rate limit before touching shared state so a flooding client
+        // cannot contend on clientsMutex or the log
+        bool wasLimited = limiter.isLimited();
+        InboundRateLimiter::Verdict verdict = limiter.admit(bytesReceived);
+        if (limiter.isLimited() && !wasLimited) {
+            logMessage("Rate limit exceeded by " + clientIP + " (action: "
+                + RateLimitPolicy::actionName(ratePolicy.action) + ")");
+        }
+        if (verdict == InboundRateLimiter::Verdict::Disconnect) {
+            break;
+        }
+        // Upload frames are never dropped since their payload follows on
+        // the socket; a client abusing that fails the protocol check
+        bool dropping = verdict == InboundRateLimiter::Verdict::Drop;
+        if (!dropping) {
+            touchClient(clientSocket);
+        }
+        
+        // Client frames end in '\n'. Upload frames carry binary payloads
+        // after their header and are consumed by the upload manager.
+        bool protocolError = false;
+        while (!buffered.empty()) {
+            if (buffered.compare(0, 7, "UPLOAD_") == 0) {
+                if (!uploads.handleFrames(clientSocket, buffered, reply)) {
+                    protocolError = true;
+                    break;
+                }
+                continue;
+            }
+            size_t newline = buffered.find('\n');
+            if (newline == std::string::npos) {
+                protocolError = buffered.size() > MAX_CLIENT_FRAME;
+                break;
+            }
+            std::string frame = buffered.substr(0, newline);
+            buffered.erase(0, newline + 1);
+            if (!frame.empty() && !dropping) {
+                processClientMessage(clientSocket, clientIP, frame, channel);
+            }
+        }
+        if (protocolError) {
+            logMessage("Protocol error from " + clientIP + ", dropping connection");
+            break;
+        }
+    }
+    
+    uploads.clientGone(clientSocket);
+    queries.clientGone(clientSocket);
+    
+    // Clean up disconnected client
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        capture.clientDisconnected(clientSocket);
+        topics.clientGone(clientSocket);
+        codec.clientGone(clientSocket);
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+            [clientSocket](const Client& c) { return c.socket == clientSocket; }),
+            clients.end());
+        channels.erase(clientSocket);
+    }
+    
+    // Queued writes are dropped before the descriptor can be reused
+    runtime.closeChannel(channel);
+    close(clientSocket);
+    registry.disconnected(clientIP, time(nullptr));
+    PresenceFeed::Report report = presence.disconnected(clientIP);
+    if (report == PresenceFeed::Report::Publish) {
+        logMessage("Client disconnected: " + clientIP);
+    } else {
+        logPresenceDamping(clientIP, report);
+    }
+}
+
+// One frame, without its trailing newline
+void ServerManager::processClientMessage(int clientSocket, const std::string& clientIP, const std::string& message,
+                                         const std::shared_ptr<TaskRuntime::Channel>& channel) {
+    if (message == "PING") {
+        static const auto pong = std::make_shared<const std::string>("PONG");
+        runtime.write(channel, pong, CLIENT_WRITE_TIMEOUT);
+    } else if (message.compare(0, 13, "QUERY_RESULT:") == 0) {
+        queries.answer(clientSocket, message.substr(13));
+    } else if (message.compare(0, 16, "CLIENT_CONNECTED") == 0) {
+        clientHandshake(clientSocket, clientIP, message);
+    } else if (message.compare(0, 10, "SUBSCRIBE:") == 0) {
+        subscribeFromClient(clientSocket, clientIP, message.substr(10), true);
+    } else if (message.compare(0, 12, "UNSUBSCRIBE:") == 0) {
+        subscribeFromClient(clientSocket, clientIP, message.substr(12), false);
+    } else {
+        logMessage("Received from " + clientIP + ": " + message);
+    }
+}
+
+// "CLIENT_CONNECTED [compress=deflate[:<dictionary id>]] [topics=a,b]"
+void ServerManager::clientHandshake(int clientSocket, const std::string& clientIP, const std::string& message) {
+    logMessage("Client announcement from " + clientIP);
+    
+    std::istringstream tokens(message.substr(16));
+    std::string token;
+    std::string topicList;
+    while (tokens >> token) {
+        if (token.compare(0, 9, "compress=") == 0) {
+            PayloadCodec::Encoding encoding = codec.negotiate(clientSocket, token.substr(9));
+            logMessage("Client " + clientIP + " negotiated " + PayloadCodec::encodingName(encoding) + " payloads");
+        } else if (token.compare(0, 7, "topics=") == 0) {
+            topicList = token.substr(7);
+        }
+    }
+    if (!topicList.empty()) {
+        subscribeFromClient(clientSocket, clientIP, topicList, true);
+    }
+}
+
+// names is a comma-separated topic list
+void ServerManager::subscribeFromClient(int clientSocket, const std::string& clientIP, const std::string& names, bool subscribe) {
+    std::istringstream list(names);
+    std::string name;
+    std::string joined;
+    while (std::getline(list, name, ',')) {
+        name.erase(name.find_last_not_of(" \n\r\t") + 1);
+        if (name.empty()) continue;
+        bool changed = subscribe ? topics.subscribe(clientSocket, clientIP, name)
+                                 : topics.unsubscribe(clientSocket, name);
+        if (!changed && subscribe) {
+            logMessage("Rejected subscription of " + clientIP + " to topic " + name);
+            continue;
+        }
+        if (changed) joined += (joined.empty() ? "" : ",") + name;
+    }
+    if (!joined.empty()) {
+        logMessage("Client " + clientIP + (subscribe ? " subscribed to " : " unsubscribed from ") + joined);
+    }
+}
+
+void ServerManager::handleJavaBridge(int javaClientSocket) {
+    char buffer[2048];
+    
+    while (running) {
+        memset(buffer, 0, sizeof(buffer));
+        int bytesReceived = recv(javaClientSocket, buffer, sizeof(buffer) - 1, 0);
+        
+        if (bytesReceived <= 0) {
+            break; // Java bridge disconnected
+        }
+        
+        int64_t receivedAt = TraceRecorder::now();
+        std::string command(buffer, bytesReceived);
+        command.erase(command.find_last_not_of(" \n\r\t") + 1); // trim
+        
+        // Sampled requests carry the bridge's trace id and timestamps
+        TraceRecorder::Trace trace;
+        bool traced = TraceRecorder::parsePrefix(command, trace);
+        if (traced) {
+            TraceRecorder::addStage(trace, "bridge_receive", receivedAt);
+        }
+        
+        logMessage("Java bridge command: " + command);
+        if (command.compare(0, 7, "capture") != 0) {
+            capture.bridgeCommand(javaClientSocket, command);
+        }
+        
+        // Long-running commands stream progress lines ahead of the response
+        Progress progress = [javaClientSocket](const std::string& line) {
+            std::string chunk = line + "\n";
+            send(javaClientSocket, chunk.c_str(), chunk.length(), MSG_NOSIGNAL);
+        };
+        
+        std::string response;
+        {
+            TraceRecorder::Scope scope(traced ? &trace : nullptr);
+            response = processCommand(command, progress);
+        }
+        response += "\nEND_RESPONSE\n";
+        
+        send(javaClientSocket, response.c_str(), response.length(), 0);
+        
+        if (traced) {
+            TraceRecorder::addStage(trace, "bridge_respond", TraceRecorder::now());
+            traces.commit(std::move(trace));
+        }
+    }
+    
+    capture.bridgeDisconnected(javaClientSocket);
+    close(javaClientSocket);
+    logMessage("Java bridge disconnected");
+}
+
+std::string ServerManager::processCommand(const std::string& command, const Progress& progress) {
+    std::istringstream iss(command);
+    std::string cmd;
+    iss >> cmd;
+    TraceRecorder::mark("command_parse");
+    
+    if (cmd == "message_all") { // Changed to 'if'
+        std::string message = command.substr(cmd.length());
+        if (!message.empty() && message[0] == ' ') {
+            message = message.substr(1);
+        }
+        return sendMessageToClients(message);
+    }
+    else if (cmd == "message_single") {
+        std::string args = command.substr(cmd.length() + 1);
+        size_t firstSpace = args.find(' ');
+        if (firstSpace == std::string::npos) {
+            return "{\"error\": \"Invalid message_single command format\"}";
+        }
+        std::string targetIp = args.substr(0, firstSpace);
+        std::string message = args.substr(firstSpace + 1);
+        return sendMessageToClient(targetIp, message);
+    }
+    else if (cmd == "publish") {
+        std::string topic;
+        if (!(iss >> topic)) {
+            return "{\"error\": \"Usage: publish <topic> <text>\"}";
+        }
+        std::string message;
+        std::getline(iss, message);
+        if (!message.empty() && message[0] == ' ') {
+            message = message.substr(1);
+        }
+        return publish(topic, message);
+    }
+    else if (cmd == "subscribe" || cmd == "unsubscribe") {
+        std::string targetIp, topic;
+        if (!(iss >> targetIp >> topic)) {
+            return "{\"error\": \"Usage: " + cmd + " <ip> <topic>\"}";
+        }
+        return subscribeClient(targetIp, topic, cmd == "subscribe");
+    }
+    else if (cmd == "topics") {
+        std::string topic;
+        iss >> topic;
+        return listTopics(topic);
+    }
+    else if (cmd == "compression") {
+        return codec.status();
+    }
+    else if (cmd == "query_all") {
+        return queryAll(iss, progress);
+    }
+    else if (cmd == "capture") {
+        return captureCommand(iss);
+    }
+    else if (cmd == "tasks") {
+        return tasksCommand(iss);
+    }
+    // You should add handling for other commands here (e.g., "show_ips", "kill_switch", "stop", "help")
+    // Example:
+    else if (cmd == "show_ips") {
+        std::string arg;
+        if (iss >> arg) {
+            if (arg.compare(0, 6, "since=") != 0) {
+                return "{\"error\": \"Usage: show_ips [since=<version>]\"}";
+            }
+            return presenceSince(strtoull(arg.c_str() + 6, nullptr, 10));
+        }
+        return showConnectedIPs();
+    }
+    else if (cmd == "schedule") {
+        return scheduleMessage(iss);
+    }
+    else if (cmd == "list_scheduled") {
+        return listScheduled();
+    }
+    else if (cmd == "cancel") {
+        uint64_t id;
+        if (!(iss >> id)) {
+            return "{\"error\": \"Usage: cancel <id>\"}";
+        }
+        MessageScheduler::CancelResult result = scheduler.cancel(id);
+        if (result == MessageScheduler::CancelResult::BuiltIn) {
+            return "{\"error\": \"Job " + std::to_string(id) + " is built in and cannot be cancelled\"}";
+        }
+        if (result == MessageScheduler::CancelResult::NotFound) {
+            return "{\"error\": \"No scheduled message with id " + std::to_string(id) + "\"}";
+        }
+        logMessage("Cancelled scheduled message " + std::to_string(id));
+        return "{\"cancelled\": " + std::to_string(id) + "}";
+    }
+    else if (cmd == "request_upload") {
+        std::string targetIp, name;
+        if (!(iss >> targetIp >> name)) {
+            return "{\"error\": \"Usage: request_upload <ip> <name>\"}";
+        }
+        return requestUpload(targetIp, name);
+    }
+    else if (cmd == "list_uploads") {
+        return uploads.status();
+    }
+    else if (cmd == "rate_limit") {
+        return configureRateLimit(iss);
+    }
+    else if (cmd == "rate_stats") {
+        return rateStats();
+    }
+    else if (cmd == "offline_since") {
+        long minSeconds = 0;
+        iss >> minSeconds;
+        return offlineSince(minSeconds);
+    }
+    else if (cmd == "trace") {
+        return traceCommand(iss);
+    }
+    else if (cmd == "trace_report") {
+        std::string id;
+        iss >> id;
+        if (!traces.report(id, iss)) {
+            return "{\"error\": \"Trace " + escapeJson(id) + " not found\"}";
+        }
+        return "{\"status\": \"ok\"}";
+    }
+    else if (cmd == "kill_switch") {
+        return killSwitch(); // Make sure killSwitch returns a string
+    }
+    else if (cmd == "stop") {
+        stop(); // stop() calls exit(0), so it doesn't return a string
+        return "{\"status\": \"Server stopping\"}"; // Or handle appropriately
+    }
+    else if (cmd == "help") {
+         return "{\"info\": \"Available commands: message_all <text>, message_single <ip> <text>, publish <topic> <text>, subscribe <ip> <topic>, unsubscribe <ip> <topic>, topics [<topic>], compression, capture [start [<file>] | stop], tasks [cancel <id>], query_all <kind> [topic=<name> | ip=<a,b>] [timeout=<s>], show_ips [since=<version>], schedule <when> <text>, list_scheduled, cancel <id>, request_upload <ip> <name>, list_uploads, rate_limit [<frames/s> <bytes/s> <drop|throttle|disconnect>], rate_stats, offline_since [seconds], trace [<id> | chrome [<id>]], trace_report <id> <stage>=<ns>..., kill_switch, stop, help\"}";
+    }
+    else {
+        return "{\"error\": \"Unknown command\"}";
+    }
+}
+
+// clientsMutex is only held to collect the recipients; the writes run in
+// parallel afterwards, so a client that stops reading delays nobody else.
+std::string ServerManager::sendMessageToClients(const std::string& message) {
+    TraceRecorder::mark("fanout_start");
+    
+    // Built once; clients that negotiated compression share one deflated copy
+    PayloadCodec::Frame frame(codec, "MSG:" + message);
+    std::vector<Recipient> recipients = connectedRecipients(frame);
+    std::vector<TaskRuntime::WriteResult> results = deliver("message_all", recipients, FANOUT_TIMEOUT);
+    TraceRecorder::mark("fanout_finish");
+    return reportMessageAll(message, frame, recipients, results);
+}
+
+std::vector<ServerManager::Recipient> ServerManager::connectedRecipients(PayloadCodec::Frame& frame) {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    std::vector<Recipient> recipients;
+    recipients.reserve(clients.size());
+    for (const auto& client : clients) {
+        if (client.connected) {
+            recipients.push_back(recipient(client.socket, client.ip, frame));
+        }
+    }
+    return recipients;
+}
+
+std::string ServerManager::reportMessageAll(const std::string& message, const PayloadCodec::Frame& frame,
+                                            const std::vector<Recipient>& recipients,
+                                            const std::vector<TaskRuntime::WriteResult>& results) {
+    int sentCount = 0;
+    uint64_t plainBytes = 0;
+    uint64_t sentBytes = 0;
+    for (size_t i = 0; i < recipients.size(); i++) {
+        if (results[i].ok) {
+            logMessage("Send to " + recipients[i].ip + " {\"" + message + "\"}");
+            sentCount++;
+            plainBytes += frame.text().size();
+            sentBytes += recipients[i].payload->size();
+        } else {
+            logMessage("Failed to send to " + recipients[i].ip);
+        }
+    }
+    codec.recordFanout(plainBytes, sentBytes);
+    
+    return "{\"sent_clients\": " + std::to_string(sentCount) + "}"; // Corrected JSON
+}
+
+// One payload is built per publish and written to every subscriber; the
+// subscriber list comes from the topic, so clients outside it cost nothing.
+// Writes go through the subscribers' channels, which are closed before
+// their sockets, so a disconnecting client's descriptor cannot be reused
+// mid-publish.
+std::string ServerManager::publish(const std::string& topic, const std::string& message) {
+    if (!TopicRegistry::validName(topic)) {
+        return "{\"error\": \"Invalid topic name\"}";
+    }
+    
+    PayloadCodec::Frame frame(codec, "TOPIC:" + topic + ":" + message);
+    uint64_t delivered = 0;
+    uint64_t failed = 0;
+    uint64_t sentBytes = 0;
+    TraceRecorder::mark("fanout_start");
+    std::vector<Recipient> recipients;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& subscriber : topics.beginPublish(topic)) {
+            recipients.push_back(recipient(subscriber.socket, subscriber.ip, frame));
+        }
+    }
+    std::vector<TaskRuntime::WriteResult> results = deliver("publish", recipients, FANOUT_TIMEOUT);
+    for (size_t i = 0; i < recipients.size(); i++) {
+        if (results[i].ok) {
+            delivered++;
+            sentBytes += recipients[i].payload->size();
+        } else {
+            failed++;
+            logMessage("Failed to send to " + recipients[i].ip);
+        }
+    }
+    TraceRecorder::mark("fanout_finish");
+    topics.finishPublish(topic, delivered, failed);
+    codec.recordFanout(delivered * frame.text().size(), sentBytes);
+    
+    logMessage("Published to topic " + topic + " (" + std::to_string(delivered) + " subscribers) {\""
+        + message + "\"}");
+    return "{\"topic\": \"" + topic + "\", \"sent_clients\": " + std::to_string(delivered)
+        + ", \"failed\": " + std::to_string(failed) + "}";
+}
+
+// Operator-side subscription change. The client is told as well so it
+// re-announces the topic in its handshake after a reconnect.
+std::string ServerManager::subscribeClient(const std::string& targetIp, const std::string& topic, bool subscribe) {
+    if (!TopicRegistry::validName(topic)) {
+        return "{\"error\": \"Invalid topic name\"}";
+    }
+    
+    auto notice = std::make_shared<const std::string>((subscribe ? "SUBSCRIBE:" : "UNSUBSCRIBE:") + topic);
+    int changed = 0;
+    bool found = false;
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    for (const auto& client : clients) {
+        if (!client.connected || client.ip != targetIp) continue;
+        found = true;
+        bool ok = subscribe ? topics.subscribe(client.socket, client.ip, topic)
+                            : topics.unsubscribe(client.socket, topic);
+        if (subscribe && !ok) {
+            return "{\"error\": \"Client " + targetIp + " is subscribed to too many topics\"}";
+        }
+        runtime.write(channelFor(client.socket), notice, CLIENT_WRITE_TIMEOUT);
+        if (ok) changed++;
+    }
+    if (!found) {
+        return "{\"error\": \"Client " + targetIp + " not found or not connected\"}";
+    }
+    
+    logMessage("Client " + targetIp + (subscribe ? " subscribed to " : " unsubscribed from ") + topic);
+    return "{\"ip\": \"" + targetIp + "\", \"topic\": \"" + topic + "\", \"subscribed\": "
+        + (subscribe ? "true" : "false") + ", \"changed\": " + std::to_string(changed) + "}";
+}
+
+// topics: every topic with its counters; topics <name>: that topic's subscribers
+std::string ServerManager::listTopics(const std::string& topic) {
+    std::ostringstream oss;
+    if (!topic.empty()) {
+        if (!TopicRegistry::validName(topic)) {
+            return "{\"error\": \"Invalid topic name\"}";
+        }
+        std::vector<std::string> ips = topics.subscriberIps(topic);
+        oss << "{\"topic\": \"" << topic << "\", \"subscribers\": [";
+        for (size_t i = 0; i < ips.size(); i++) {
+            if (i > 0) oss << ",";
+            oss << "\"" << ips[i] << "\"";
+        }
+        oss << "], \"count\": " << ips.size() << "}";
+        return oss.str();
+    }
+    
+    std::vector<TopicRegistry::Stats> stats = topics.stats();
+    oss << "{\"topics\": [";
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (i > 0) oss << ",";
+        oss << "{\"topic\": \"" << stats[i].name << "\", \"subscribers\": " << stats[i].subscribers
+            << ", \"published\": " << stats[i].published << ", \"delivered\": " << stats[i].delivered
+            << ", \"failed\": " << stats[i].failed << ", \"last_published\": \""
+            << (stats[i].lastPublished ? formatTime(stats[i].lastPublished) : "") << "\"}";
+    }
+    oss << "], \"count\": " << stats.size() << "}";
+    return oss.str();
+}
+
+// query_all <kind> [topic=<name> | ip=<a,b,...>] [timeout=<seconds>]
+// Blocks until every target answered or the timeout passed, emitting the
+// running aggregate through progress whenever answers came in.
+std::string ServerManager::queryAll(std::istringstream& iss, const Progress& progress) {
+    std::string kindName;
+    iss >> kindName;
+    const FleetQueries::Kind* kind = FleetQueries::findKind(kindName);
+    if (!kind) {
+        return "{\"error\": \"Usage: query_all <" + FleetQueries::kindNames()
+            + "> [topic=<name> | ip=<a,b>] [timeout=<s>]\"}";
+    }
+    
+    std::string topic;
+    std::set<std::string> ips;
+    int timeout = QUERY_DEFAULT_TIMEOUT;
+    std::string option;
+    while (iss >> option) {
+        if (option.compare(0, 6, "topic=") == 0) {
+            topic = option.substr(6);
+        } else if (option.compare(0, 3, "ip=") == 0) {
+            std::istringstream list(option.substr(3));
+            std::string ip;
+            while (std::getline(list, ip, ',')) ips.insert(ip);
+        } else if (option.compare(0, 8, "timeout=") == 0) {
+            timeout = atoi(option.c_str() + 8);
+        } else {
+            return "{\"error\": \"Unknown query_all option " + escapeJson(option) + "\"}";
+        }
+    }
+    if (timeout <= 0 || timeout > QUERY_MAX_TIMEOUT) {
+        return "{\"error\": \"timeout must be 1-" + std::to_string(QUERY_MAX_TIMEOUT) + " seconds\"}";
+    }
+    
+    std::shared_ptr<FleetQueries::Query> query;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        std::vector<FleetQueries::Target> targets;
+        if (!topic.empty()) {
+            for (const auto& subscriber : topics.subscribers(topic)) {
+                targets.push_back({subscriber.socket, subscriber.ip});
+            }
+        } else {
+            for (const auto& client : clients) {
+                if (client.connected && (ips.empty() || ips.count(client.ip))) {
+                    targets.push_back({client.socket, client.ip});
+                }
+            }
+        }
+        
+        // Registered before sending so fast answers are not dropped
+        query = queries.start(*kind, targets);
+        auto request = std::make_shared<const std::string>(
+            "QUERY:" + std::to_string(query->queryId()) + ":" + kind->name + "\n");
+        for (const auto& target : targets) {
+            runtime.write(channelFor(target.socket), request, CLIENT_WRITE_TIMEOUT);
+        }
+        logMessage("Query " + std::to_string(query->queryId()) + " (" + kind->name + ") sent to "
+            + std::to_string(targets.size()) + " clients");
+    }
+    
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+    uint64_t seen = 0;
+    while (query->wait(deadline, std::chrono::milliseconds(QUERY_PROGRESS_INTERVAL_MS))) {
+        if (progress && query->takeUpdate(seen)) {
+            progress(query->json(false));
+        }
+    }
+    
+    std::string result = query->json(true);
+    queries.finish(query->queryId());
+    logMessage("Query " + std::to_string(query->queryId()) + " finished: " + result);
+    return result;
+}
+
+std::string ServerManager::requestUpload(const std::string& targetIp, const std::string& name) {
+    int socket = -1;
+    std::shared_ptr<TaskRuntime::Channel> channel;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& client : clients) {
+            if (client.connected && client.ip == targetIp) {
+                socket = client.socket;
+                channel = channelFor(client.socket);
+                break;
+            }
+        }
+    }
+    if (!channel) {
+        return "{\"error\": \"Client " + targetIp + " not found or not connected\"}";
+    }
+
+    // Upload frames share the client's channel with every other write. Each
+    // send waits for its write to finish, so the bridge is only told the
+    // upload was requested once the client's socket took the request.
+    return uploads.request(socket, targetIp, name, [this, channel](const std::string& frame) {
+        auto written = std::make_shared<std::promise<bool>>();
+        std::future<bool> result = written->get_future();
+        runtime.write(channel, std::make_shared<const std::string>(frame), CLIENT_WRITE_TIMEOUT,
+            [written](bool ok) { written->set_value(ok); });
+        return result.get();
+    });
+}
+
+std::string ServerManager::configureRateLimit(std::istringstream& iss) {
+    long frames, bytes;
+    std::string actionText;
+    if (iss >> frames) {
+        if (!(iss >> bytes >> actionText) || frames <= 0 || bytes <= 0
+                || RateLimitPolicy::parseAction(actionText) < 0) {
+            return "{\"error\": \"Usage: rate_limit <frames/s> <bytes/s> <drop|throttle|disconnect>\"}";
+        }
+        ratePolicy.framesPerSecond = frames;
+        ratePolicy.bytesPerSecond = bytes;
+        ratePolicy.action = RateLimitPolicy::parseAction(actionText);
+        logMessage("Rate limit set to " + std::to_string(frames) + " frames/s, "
+            + std::to_string(bytes) + " bytes/s, action " + actionText);
+    }
+    
+    return "{\"frames_per_sec\": " + std::to_string(ratePolicy.framesPerSecond.load())
+        + ", \"bytes_per_sec\": " + std::to_string(ratePolicy.bytesPerSecond.load())
+        + ", \"burst_seconds\": " + std::to_string(ratePolicy.burstSeconds.load())
+        + ", \"action\": \"" + RateLimitPolicy::actionName(ratePolicy.action) + "\"}";
+}
+
+std::string ServerManager::rateStats() {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    std::ostringstream oss;
+    oss << "{\"frames_dropped\": " << ratePolicy.framesDropped
+        << ", \"throttle_waits\": " << ratePolicy.throttleWaits
+        << ", \"throttled_ms\": " << ratePolicy.throttledMillis
+        << ", \"disconnects\": " << ratePolicy.disconnects
+        << ", \"clients\": [";
+    
+    bool first = true;
+    for (const auto& client : clients) {
+        const ClientRateStats& stats = *client.rateStats;
+        if (!first) oss << ",";
+        oss << "{\"ip\": \"" << client.ip << "\", \"frames\": " << stats.frames
+            << ", \"bytes\": " << stats.bytes << ", \"dropped\": " << stats.dropped
+            << ", \"throttled_ms\": " << stats.throttledMillis << "}";
+        first = false;
+    }
+    
+    oss << "]}";
+    return oss.str();
+}
+
+std::string ServerManager::showConnectedIPs() {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    std::ostringstream oss;
+    oss << "{\"clients\": [";
+    
+    bool first = true;
+    for (const auto& client : clients) {
+        if (client.connected) {
+            if (!first) oss << ",";
+            oss << "\"" << client.ip << "\"";
+            first = false;
+        }
+    }
+    
+    oss << "], \"count\": " << clients.size() << ", \"version\": " << presence.currentVersion() << "}";
+    return oss.str();
+}
+
+// KILL_SWITCH goes to every client at once, then each socket is shut down.
+// Their receive threads see the disconnect and clean up, so registry and
+// presence record it like any other and no descriptor is closed twice.
+std::string ServerManager::killSwitch() {
+    auto notice = std::make_shared<const std::string>("KILL_SWITCH");
+    std::vector<Recipient> recipients;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (auto& client : clients) {
+            if (client.connected) {
+                recipients.push_back({client.socket, client.ip, channelFor(client.socket), notice});
+                client.connected = false;
+            }
+        }
+    }
+    
+    deliver("kill_switch", recipients, SHUTDOWN_TIMEOUT);
+    for (const auto& target : recipients) {
+        runtime.shutdownChannel(target.channel);
+        logMessage("Force disconnected: " + target.ip);
+    }
+    return "{\"disconnected_clients\": " + std::to_string(recipients.size()) + "}"; // Corrected return
+}
+
+void ServerManager::stop() {
+    running = false;
+    wakeScheduler();
+    
+    // Send graceful shutdown to all clients
+    auto notice = std::make_shared<const std::string>("SERVER_SHUTDOWN");
+    std::vector<std::pair<std::string, time_t>> lastSeen;
+    std::vector<Recipient> recipients;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (auto& client : clients) {
+            lastSeen.emplace_back(client.ip, client.lastPing);
+            if (client.connected) {
+                recipients.push_back({client.socket, client.ip, channelFor(client.socket), notice});
+            }
+        }
+    }
+    deliver("stop", recipients, SHUTDOWN_TIMEOUT);
+    for (const auto& target : recipients) {
+        runtime.shutdownChannel(target.channel);
+    }
+    
+    persistRegistry(lastSeen);
+    
+    if (serverSocket >= 0) close(serverSocket);
+    if (javaSocket >= 0) close(javaSocket);
+    
+    logMessage("Server stopped gracefully");
+    exit(0);
+}
+
+// Caller holds clientsMutex. Clients added without going through accept
+// (server_bench.cpp) get their channel on first use.
+std::shared_ptr<TaskRuntime::Channel> ServerManager::channelFor(int socket) {
+    std::shared_ptr<TaskRuntime::Channel>& channel = channels[socket];
+    if (!channel) channel = std::make_shared<TaskRuntime::Channel>(socket);
+    return channel;
+}
+
+// Caller holds clientsMutex
+ServerManager::Recipient ServerManager::recipient(int socket, const std::string& ip, PayloadCodec::Frame& frame) {
+    return {socket, ip, channelFor(socket), frame.sharedForSocket(socket)};
+}
+
+// Runs writeAll as a task and waits for it, so call it from bridge or CLI
+// threads, never from a task; tasks co_await writeAll and call recordWrites.
+// timeout bounds the whole fan-out.
+std::vector<TaskRuntime::WriteResult> ServerManager::deliver(const char* task, const std::vector<Recipient>& recipients,
+                                                             std::chrono::seconds timeout) {
+    std::vector<TaskRuntime::WriteResult> results = runtime.spawn<std::vector<TaskRuntime::WriteResult>>(task,
+        [this, recipients](CancelToken token) { return writeAll(recipients, token); }, timeout).get();
+    recordWrites(recipients, results);
+    return results;
+}
+
+// A failed write marks its client disconnected like a failed send did
+void ServerManager::recordWrites(const std::vector<Recipient>& recipients,
+                                 const std::vector<TaskRuntime::WriteResult>& results) {
+    std::set<int> failed;
+    for (size_t i = 0; i < recipients.size(); i++) {
+        if (!results[i].ok) {
+            failed.insert(recipients[i].socket);
+        } else if (TraceRecorder::active()) {
+            TraceRecorder::markAt("client_write", results[i].finishedNs, recipients[i].ip);
+        }
+    }
+    if (!failed.empty()) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (auto& client : clients) {
+            if (failed.count(client.socket)) client.connected = false;
+        }
+    }
+}
+
+// Every write starts at once; a client that is not reading holds up only
+// its own entry, for at most CLIENT_WRITE_TIMEOUT
+Task<std::vector<TaskRuntime::WriteResult>> ServerManager::writeAll(std::vector<Recipient> recipients, CancelToken token) {
+    TaskRuntime::WriteBatch batch(runtime);
+    for (const auto& target : recipients) {
+        if (token.cancelled()) break;
+        batch.add(target.channel, target.payload, CLIENT_WRITE_TIMEOUT);
+    }
+    std::vector<TaskRuntime::WriteResult> results = co_await batch.wait(token);
+    results.resize(recipients.size(), {false, 0});
+    co_return results;
+}
+
+// Update last ping time
+void ServerManager::touchClient(int clientSocket) {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    auto it = std::find_if(clients.begin(), clients.end(),
+        [clientSocket](const Client& c) { return c.socket == clientSocket; });
+    if (it != clients.end()) {
+        it->lastPing = time(nullptr);
+    }
+}
+
+// Drops clients that missed their pings and reports last-seen times of the
+// rest. Their sockets are shut down, not closed; the receive thread closes
+// them once its channel is closed.
+void ServerManager::pruneStaleClients(time_t now, std::vector<std::pair<std::string, time_t>>& lastSeen) {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+        [this, now](Client& c) {
+            if (now - c.lastPing > 30) { // 30 second timeout
+                runtime.shutdownChannel(channelFor(c.socket));
+                return true;
+            }
+            return false;
+        }), clients.end());
+    
+    for (const auto& client : clients) {
+        lastSeen.emplace_back(client.ip, client.lastPing);
+    }
+}
+
+Task<void> ServerManager::monitorPings(CancelToken token) {
+    while (running && co_await runtime.sleep(PING_CHECK_INTERVAL, token)) {
+        std::vector<std::pair<std::string, time_t>> lastSeen;
+        pruneStaleClients(time(nullptr), lastSeen);
+        co_await runtime.offload([this, &lastSeen] { persistRegistry(lastSeen); });
+        releaseDampedPresence();
+    }
+}
+
+// Flapping clients only produce log lines when damping starts and ends
+void ServerManager::logPresenceDamping(const std::string& clientIP, PresenceFeed::Report report) {
+    if (report == PresenceFeed::Report::Suppressed) {
+        logMessage("Client " + clientIP + " is flapping, suppressing presence updates");
+    }
+}
+
+void ServerManager::releaseDampedPresence() {
+    for (const auto& released : presence.releaseDamped()) {
+        logMessage("Client " + released.ip + " stable again (" + (released.online ? "online" : "offline")
+            + ", " + std::to_string(released.hiddenTransitions) + " suppressed transitions)");
+    }
+}
+
+std::string ServerManager::presenceSince(uint64_t since) {
+    releaseDampedPresence();
+    
+    uint64_t version;
+    std::vector<std::string> suppressed;
+    std::vector<PresenceFeed::Change> changes = presence.changesSince(since, version, suppressed);
+    
+    std::ostringstream oss;
+    oss << "{\"version\": " << version << ", \"since\": " << since << ", \"changes\": [";
+    for (size_t i = 0; i < changes.size(); i++) {
+        if (i > 0) oss << ",";
+        oss << "{\"ip\": \"" << changes[i].ip << "\", \"online\": " << (changes[i].online ? "true" : "false")
+            << ", \"version\": " << changes[i].version << "}";
+    }
+    oss << "], \"suppressed\": [";
+    for (size_t i = 0; i < suppressed.size(); i++) {
+        if (i > 0) oss << ",";
+        oss << "\"" << suppressed[i] << "\"";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+// Folds the delta log and current last-seen times into a new snapshot
+void ServerManager::persistRegistry(const std::vector<std::pair<std::string, time_t>>& lastSeen) {
+    registry.updateLastSeen(lastSeen);
+    if (!registry.compact()) {
+        logMessage("Failed to write registry snapshot " + REGISTRY_SNAPSHOT);
+    }
+}
+
+std::string ServerManager::offlineSince(long minSeconds) {
+    time_t now = time(nullptr);
+    std::vector<ClientRegistry::Entry> offline = registry.offline(now, minSeconds);
+    std::ostringstream oss;
+    oss << "{\"offline\": [";
+    
+    bool first = true;
+    for (const auto& entry : offline) {
+        if (!first) oss << ",";
+        oss << "{\"ip\": \"" << entry.ip << "\", \"offline_since\": \"" << formatTime(entry.lastSeen)
+            << "\", \"offline_seconds\": " << (now - entry.lastSeen)
+            << ", \"first_seen\": \"" << formatTime(entry.firstSeen)
+            << "\", \"connects\": " << entry.connects << "}";
+        first = false;
+    }
+    
+    oss << "], \"count\": " << offline.size() << ", \"known\": " << registry.size() << "}";
+    return oss.str();
+}
+
+// capture: status; capture start [<file>]: begin a journal; capture stop: close it
+std::string ServerManager::captureCommand(std::istringstream& iss) {
+    std::string action;
+    iss >> action;
+    if (action == "start") {
+        std::string file = CAPTURE_FILE;
+        iss >> file;
+        if (!TrafficCapture::validName(file)) {
+            return "{\"error\": \"Invalid capture name " + escapeJson(file) + "\"}";
+        }
+        bool started;
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            std::vector<std::pair<int, std::string>> connected;
+            connected.reserve(clients.size());
+            for (const auto& client : clients) connected.emplace_back(client.socket, client.ip);
+            started = capture.start(file, connected);
+        }
+        if (!started) {
+            return "{\"error\": \"Capture already running or cannot open " + escapeJson(CAPTURE_DIR + "/" + file) + "\"}";
+        }
+        logMessage("Traffic capture started: " + CAPTURE_DIR + "/" + file);
+    } else if (action == "stop") {
+        capture.stop();
+        logMessage("Traffic capture stopped");
+    } else if (!action.empty()) {
+        return "{\"error\": \"Usage: capture [start [<file>] | stop]\"}";
+    }
+    return capture.status();
+}
+
+// tasks: running tasks and write counters; tasks cancel <id>: cancel one
+std::string ServerManager::tasksCommand(std::istringstream& iss) {
+    std::string action;
+    if (!(iss >> action)) {
+        return runtime.status();
+    }
+    uint64_t id;
+    if (action != "cancel" || !(iss >> id)) {
+        return "{\"error\": \"Usage: tasks [cancel <id>]\"}";
+    }
+    if (!runtime.cancel(id)) {
+        return "{\"error\": \"No running task with id " + std::to_string(id) + "\"}";
+    }
+    logMessage("Cancelled task " + std::to_string(id));
+    return "{\"cancelled\": " + std::to_string(id) + "}";
+}
+
+// trace: recent traces; trace <id>: stage breakdown; trace chrome [<id>]: Chrome trace JSON
+std::string ServerManager::traceCommand(std::istringstream& iss) {
+    std::string arg;
+    if (!(iss >> arg)) {
+        return traces.summaryJson();
+    }
+    if (arg == "chrome") {
+        std::string id;
+        iss >> id;
+        return traces.chromeJson(id);
+    }
+    std::string detail = traces.detailJson(arg);
+    if (detail.empty()) {
+        return "{\"error\": \"Trace " + escapeJson(arg) + " not found\"}";
+    }
+    return detail;
+}
+
+// The auto-update broadcast runs as a non-persistent scheduler job so it
+// is not duplicated in the schedule file on every restart.
+void ServerManager::scheduleAutoUpdateBroadcast() {
+    MessageScheduler::Job job{};
+    job.kind = MessageScheduler::Kind::Interval;
+    job.interval = AUTO_UPDATE_INTERVAL;
+    job.nextRun = time(nullptr) + AUTO_UPDATE_INTERVAL;
+    job.persistent = false;
+    job.message = "AUTO_UPDATE_CHECK";
+    scheduler.add(job);
+}
+
+// Called whenever a job is added, so a job due before the current wait
+// is not held up
+void ServerManager::wakeScheduler() {
+    std::lock_guard<std::mutex> lock(schedulerWakeMutex);
+    schedulerWake.cancel("wake");
+}
+
+// Sleeps until the earliest job is due, or SCHEDULER_MAX_WAIT so wall
+// clock changes are noticed, then fires every due job in order
+Task<void> ServerManager::runScheduler(CancelToken token) {
+    while (running && !token.cancelled()) {
+        CancelToken wake;
+        {
+            std::lock_guard<std::mutex> lock(schedulerWakeMutex);
+            schedulerWake = wake;
+        }
+        uint64_t stopLink = token.onCancel([wake]() mutable { wake.cancel("stop"); });
+        
+        time_t due = scheduler.nextDue();
+        time_t now = time(nullptr);
+        std::chrono::seconds delay = due == 0 ? SCHEDULER_MAX_WAIT
+            : std::min<std::chrono::seconds>(SCHEDULER_MAX_WAIT, std::chrono::seconds(std::max<time_t>(0, due - now)));
+        if (delay.count() > 0) {
+            co_await runtime.sleep(delay, wake);
+        }
+        token.removeCallback(stopLink);
+        
+        for (const auto& job : scheduler.takeDue(time(nullptr))) {
+            co_await fireScheduledJob(job, token);
+        }
+    }
+}
+
+Task<void> ServerManager::fireScheduledJob(MessageScheduler::Job job, CancelToken token) {
+    if (!running) co_return;
+    PayloadCodec::Frame frame(codec, "MSG:" + job.message);
+    std::vector<Recipient> recipients = connectedRecipients(frame);
+    std::vector<TaskRuntime::WriteResult> results = co_await writeAll(recipients, token);
+    recordWrites(recipients, results);
+    std::string result = reportMessageAll(job.message, frame, recipients, results);
+    if (job.persistent) {
+        logMessage("Scheduled message " + std::to_string(job.id) + " fired: " + result);
+    } else {
+        logMessage("Auto-update broadcast sent to all clients");
+    }
+}
+
+std::string ServerManager::scheduleMessage(std::istringstream& iss) {
+    MessageScheduler::Job job{};
+    job.persistent = true;
+    if (!MessageScheduler::parseWhen(iss, job, time(nullptr))) {
+        return "{\"error\": \"Usage: schedule <at HH:MM | in 10m | every 1h | every day HH:MM | every <weekday> [HH:MM]> <text>\"}";
+    }
+    
+    std::getline(iss, job.message);
+    size_t start = job.message.find_first_not_of(' ');
+    job.message = start == std::string::npos ? "" : job.message.substr(start);
+    if (job.message.empty()) {
+        return "{\"error\": \"Scheduled message text is empty\"}";
+    }
+    
+    uint64_t id = scheduler.add(job);
+    logMessage("Scheduled message " + std::to_string(id) + " (" + MessageScheduler::describe(job)
+        + ", next " + formatTime(job.nextRun) + ") {\"" + job.message + "\"}");
+    return "{\"scheduled\": " + std::to_string(id) + ", \"next_run\": \"" + formatTime(job.nextRun) + "\"}";
+}
+
+std::string ServerManager::listScheduled() {
+    std::vector<MessageScheduler::Job> jobs = scheduler.list();
+    std::ostringstream oss;
+    oss << "{\"scheduled\": [";
+    
+    bool first = true;
+    for (const auto& job : jobs) {
+        if (!first) oss << ",";
+        oss << "{\"id\": " << job.id
+            << ", \"repeat\": \"" << MessageScheduler::describe(job) << "\""
+            << ", \"next_run\": \"" << formatTime(job.nextRun) << "\""
+            << ", \"persistent\": " << (job.persistent ? "true" : "false")
+            << ", \"message\": \"" << escapeJson(job.message) << "\"}";
+        first = false;
+    }
+    
+    oss << "], \"count\": " << jobs.size() << "}";
+    return oss.str();
+}
+
+std::string ServerManager::formatTime(time_t when) {
+    struct tm* local = std::localtime(&when);
+    if (!local) return "invalid time " + std::to_string(when);
+    std::ostringstream oss;
+    oss << std::put_time(local, "%Y-%m-%d %H:%M:%S");
+    return oss.str();
+}
+
+std::string ServerManager::escapeJson(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+std::string ServerManager::formatLogEntry(const std::string& message) {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    auto tm = *std::localtime(&time_t);
+    
+    std::ostringstream oss;
+    oss << "[(" << std::put_time(&tm, "%Y-%m-%d")
+        << ")(" << std::put_time(&tm, "%H:%M:%S")
+        << ")] " << message;
+    
+    return oss.str();
+}
+
+void ServerManager::logMessage(const std::string& message) {
+    std::lock_guard<std::mutex> lock(logMutex);
+    
+    std::string logEntry = formatLogEntry(message);
+    
+    // Print to console
+    if (logToConsole) {
+        std::cout << logEntry << std::endl;
+    }
+    
+    // Write to log file
+    std::ofstream logFile(LOG_FILE, std::ios::app);
+    if (logFile.is_open()) {
+        logFile << logEntry << std::endl;
+        logFile.close();
+    }
+}
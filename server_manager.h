@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <sstream>
+#include <utility>
+#include <ctime>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+#include "scheduler.h"
+#include "upload_manager.h"
+#include "rate_limiter.h"
+#include "client_registry.h"
+#include "presence_feed.h"
+#include "trace.h"
+#include "topics.h"
+#include "payload_codec.h"
+#include "fleet_query.h"
+#include "traffic_capture.h"
+#include "task_runtime.h"
+
+class ServerManager {
+    // server_bench.cpp drives the private command, registry and logging
+    // paths directly without opening any ports
+    friend class ServerBench;
+
+private:
+    struct Client {
+        int socket;
+        std::string ip;
+        time_t lastPing;
+        bool connected;
+        std::shared_ptr<ClientRateStats> rateStats;
+
+        Client(int s, std::string i, std::shared_ptr<ClientRateStats> stats)
+            : socket(s), ip(i), lastPing(time(nullptr)), connected(true), rateStats(stats) {}
+    };
+
+    // One client's share of a fan-out: its payload and where to write it
+    struct Recipient {
+        int socket;
+        std::string ip;
+        std::shared_ptr<TaskRuntime::Channel> channel;
+        std::shared_ptr<const std::string> payload;
+    };
+
+    std::vector<Client> clients;
+    std::unordered_map<int, std::shared_ptr<TaskRuntime::Channel>> channels; // by socket, guarded by clientsMutex
+    std::mutex clientsMutex;
+    std::mutex logMutex;
+
+    int serverSocket;
+    int javaSocket;
+    bool running;
+    bool logToConsole;
+    const int CLIENT_PORT = 9998;
+    const int JAVA_PORT = 9999;
+    const std::string LOG_FILE = "server.log";
+    const std::string SCHEDULE_FILE = "schedule.dat";
+    const long AUTO_UPDATE_INTERVAL = 5 * 60;
+
+    const std::string UPLOAD_DIR = "uploads";
+    const std::string REGISTRY_SNAPSHOT = "registry.snap";
+    const std::string REGISTRY_LOG = "registry.log";
+    const std::string PAYLOAD_DICTIONARY = "payload.dict";
+    const std::string CAPTURE_DIR = "captures";
+    const std::string CAPTURE_FILE = "capture.bin";
+    const int QUERY_DEFAULT_TIMEOUT = 10;
+    const int QUERY_MAX_TIMEOUT = 120;
+    const int QUERY_PROGRESS_INTERVAL_MS = 500;
+    const size_t MAX_CLIENT_FRAME = 64 * 1024; // longest text frame without a newline
+    const size_t TASK_WORKERS = 4;
+    const std::chrono::seconds CLIENT_WRITE_TIMEOUT{5};
+    const std::chrono::seconds FANOUT_TIMEOUT{10};
+    const std::chrono::seconds SHUTDOWN_TIMEOUT{2};
+    const std::chrono::seconds PING_CHECK_INTERVAL{30};
+    const std::chrono::seconds SCHEDULER_MAX_WAIT{60};
+
+    MessageScheduler scheduler;
+    UploadManager uploads;
+    RateLimitPolicy ratePolicy;
+    ClientRegistry registry;
+    PresenceFeed presence;
+    TraceRecorder traces;
+    TopicRegistry topics;
+    PayloadCodec codec;
+    FleetQueries queries;
+    TrafficCapture capture;
+    TaskRuntime runtime;
+    CancelToken schedulerWake; // cancelled to wake the scheduler task early
+    std::mutex schedulerWakeMutex;
+
+public:
+    ServerManager();
+
+    void start();
+
+private:
+    // Network loops
+    void clientServerLoop();
+    void javaBridgeLoop();
+    void handleClient(int clientSocket, const std::string& clientIP, std::shared_ptr<ClientRateStats> rateStats,
+                      std::shared_ptr<TaskRuntime::Channel> channel);
+    void processClientMessage(int clientSocket, const std::string& clientIP, const std::string& message,
+                              const std::shared_ptr<TaskRuntime::Channel>& channel);
+    void clientHandshake(int clientSocket, const std::string& clientIP, const std::string& message);
+    void subscribeFromClient(int clientSocket, const std::string& clientIP, const std::string& names, bool subscribe);
+    void handleJavaBridge(int javaClientSocket);
+
+    // Commands. progress, when set, receives intermediate JSON lines of
+    // long-running commands before the final response is returned.
+    using Progress = std::function<void(const std::string&)>;
+    std::string processCommand(const std::string& command, const Progress& progress = nullptr);
+    std::string sendMessageToClient(const std::string& targetIp, const std::string& message);
+    std::string sendMessageToClients(const std::string& message);
+    std::vector<Recipient> connectedRecipients(PayloadCodec::Frame& frame);
+    std::string reportMessageAll(const std::string& message, const PayloadCodec::Frame& frame,
+                                 const std::vector<Recipient>& recipients,
+                                 const std::vector<TaskRuntime::WriteResult>& results);
+    std::string publish(const std::string& topic, const std::string& message);
+    std::string subscribeClient(const std::string& targetIp, const std::string& topic, bool subscribe);
+    std::string listTopics(const std::string& topic);
+    std::string queryAll(std::istringstream& iss, const Progress& progress);
+    std::string captureCommand(std::istringstream& iss);
+    std::string tasksCommand(std::istringstream& iss);
+    std::string requestUpload(const std::string& targetIp, const std::string& name);
+    std::string configureRateLimit(std::istringstream& iss);
+    std::string rateStats();
+    std::string showConnectedIPs();
+    std::string killSwitch();
+    void stop();
+
+    // Client writes, run as tasks on the runtime's pool
+    std::shared_ptr<TaskRuntime::Channel> channelFor(int socket);
+    Recipient recipient(int socket, const std::string& ip, PayloadCodec::Frame& frame);
+    std::vector<TaskRuntime::WriteResult> deliver(const char* task, const std::vector<Recipient>& recipients,
+                                                  std::chrono::seconds timeout);
+    void recordWrites(const std::vector<Recipient>& recipients, const std::vector<TaskRuntime::WriteResult>& results);
+    Task<std::vector<TaskRuntime::WriteResult>> writeAll(std::vector<Recipient> recipients, CancelToken token);
+
+    // Ping bookkeeping and presence
+    void touchClient(int clientSocket);
+    void pruneStaleClients(time_t now, std::vector<std::pair<std::string, time_t>>& lastSeen);
+    Task<void> monitorPings(CancelToken token);
+    void logPresenceDamping(const std::string& clientIP, PresenceFeed::Report report);
+    void releaseDampedPresence();
+    std::string presenceSince(uint64_t since);
+    void persistRegistry(const std::vector<std::pair<std::string, time_t>>& lastSeen);
+    std::string offlineSince(long minSeconds);
+    std::string traceCommand(std::istringstream& iss);
+
+    // Scheduler
+    void scheduleAutoUpdateBroadcast();
+    void wakeScheduler();
+    Task<void> runScheduler(CancelToken token);
+    Task<void> fireScheduledJob(MessageScheduler::Job job, CancelToken token);
+    std::string scheduleMessage(std::istringstream& iss);
+    std::string listScheduled();
+
+    // Formatting and logging
+    std::string formatTime(time_t when);
+    std::string escapeJson(const std::string& text);
+    std::string formatLogEntry(const std::string& message);
+    void logMessage(const std::string& message);
+};
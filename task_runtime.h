@@ -0,0 +1,893 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+#include <chrono>
+#include <sstream>
+#include <cerrno>
+#include <cstdint>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+template <typename T = void> class Task;
+
+// Promise shared by every Task<T>: lazy start, and on completion control
+// passes straight back to the awaiting coroutine.
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> finished) noexcept {
+            std::coroutine_handle<> next = finished.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+    void return_value(T result) { value = std::move(result); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+// A coroutine that starts when it is first awaited and produces a T.
+// Handlers return Task<T> and TaskRuntime::spawn runs them on the pool.
+template <typename T>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Cooperative cancellation. Copies share one state; awaitables that take a
+// token resume early once it is cancelled.
+class CancelToken {
+    struct State {
+        std::atomic<bool> cancelled{false};
+        std::mutex callbacksMutex;
+        std::string reason;
+        uint64_t nextCallback = 1;
+        std::map<uint64_t, std::function<void()>> callbacks;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+
+public:
+    bool cancelled() const { return state->cancelled.load(std::memory_order_acquire); }
+
+    std::string reason() const {
+        std::lock_guard<std::mutex> lock(state->callbacksMutex);
+        return state->reason;
+    }
+
+    // Returns false if it was already cancelled
+    bool cancel(const std::string& why) {
+        std::map<uint64_t, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(state->callbacksMutex);
+            if (state->cancelled) return false;
+            state->reason = why;
+            state->cancelled.store(true, std::memory_order_release);
+            callbacks.swap(state->callbacks);
+        }
+        for (auto& entry : callbacks) entry.second();
+        return true;
+    }
+
+    // fn runs once on cancellation, immediately if that already happened.
+    // Returns 0 in that case, otherwise an id for removeCallback.
+    uint64_t onCancel(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(state->callbacksMutex);
+            if (!state->cancelled) {
+                uint64_t id = state->nextCallback++;
+                state->callbacks.emplace(id, std::move(fn));
+                return id;
+            }
+        }
+        fn();
+        return 0;
+    }
+
+    void removeCallback(uint64_t id) {
+        if (id == 0) return;
+        std::lock_guard<std::mutex> lock(state->callbacksMutex);
+        state->callbacks.erase(id);
+    }
+};
+
+// C++20 coroutine runtime for work that used to hold a thread for its
+// whole duration: fan-out writes, the kill switch, shutdown and periodic
+// jobs. A fixed pool of workers resumes coroutines. A suspended task holds no
+// thread: sleeps wait on the timer thread, blocked socket writes on the
+// epoll thread and file work such as registry snapshots on the disk thread,
+// and all three hand the task back to the pool.
+//
+// Every client socket is written through a Channel. A write is tried at
+// once without blocking; whatever the kernel does not take is queued on
+// the channel and flushed in order when the socket drains. A write still
+// queued at its deadline fails together with the rest of the queue, and
+// the socket is shut down so its receive thread cleans the client up.
+class TaskRuntime {
+public:
+    using Clock = std::chrono::steady_clock;
+    using WriteCallback = std::function<void(bool)>;
+
+    class Channel {
+        friend class TaskRuntime;
+
+        struct Pending {
+            std::shared_ptr<const std::string> data;
+            size_t offset;
+            WriteCallback done;
+            uint64_t sequence;
+            uint64_t timer;
+        };
+
+        const int fd;
+        std::mutex channelMutex;
+        bool broken = false;     // no further writes: closed, shut down or timed out
+        bool registered = false; // fd is in the epoll set
+        uint64_t nextSequence = 1;
+        std::deque<Pending> queue;
+
+    public:
+        explicit Channel(int socket) : fd(socket) {}
+        int socket() const { return fd; }
+    };
+
+    struct WriteResult {
+        bool ok;
+        int64_t finishedNs; // steady clock, 0 if not finished
+    };
+
+private:
+    // One-shot resumption shared by a suspended coroutine and whatever may
+    // wake it (timer, cancellation, write completion); the first wins.
+    struct Wake {
+        TaskRuntime* runtime;
+        std::coroutine_handle<> handle;
+        std::atomic<bool> fired{false};
+        bool value = false;
+        std::mutex idsMutex; // held while the waker ids below are registered
+        uint64_t timer = 0;
+        uint64_t cancelCallback = 0;
+
+        explicit Wake(TaskRuntime* owner) : runtime(owner) {}
+
+        void trigger(bool result) {
+            if (fired.exchange(true)) return;
+            value = result;
+            runtime->post(handle);
+        }
+    };
+
+    // Eagerly started, self-destroying wrapper that runs a spawned task
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() const noexcept { return {}; }
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            std::suspend_never final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+    };
+
+    struct RunningTask {
+        std::string name;
+        Clock::time_point started;
+        CancelToken token;
+    };
+
+    // Worker pool
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> ready;
+    std::mutex readyMutex;
+    std::condition_variable readyChanged;
+    std::atomic<bool> stopping{false};
+
+    // Timers
+    std::thread timerThread;
+    std::multimap<Clock::time_point, uint64_t> timerQueue;
+    std::unordered_map<uint64_t, std::pair<Clock::time_point, std::function<void()>>> timers;
+    std::mutex timerMutex;
+    std::condition_variable timerChanged;
+    Clock::time_point timerWake; // when the waiting timer thread wakes by itself
+    uint64_t nextTimer = 1;
+
+    // Blocked writes
+    std::thread ioThread;
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::unordered_map<Channel*, std::shared_ptr<Channel>> watched;
+    std::mutex ioMutex;
+
+    // Offloaded file work
+    std::thread diskThread;
+    std::deque<std::function<void()>> diskJobs;
+    std::mutex diskMutex;
+    std::condition_variable diskChanged;
+
+    // Spawned tasks
+    std::map<uint64_t, RunningTask> running;
+    std::mutex tasksMutex;
+    uint64_t nextTask = 1;
+
+    // Counters for the tasks command
+    std::atomic<uint64_t> tasksSpawned{0};
+    std::atomic<uint64_t> tasksCompleted{0};
+    std::atomic<uint64_t> tasksCancelled{0};
+    std::atomic<uint64_t> tasksTimedOut{0};
+    std::atomic<uint64_t> writesImmediate{0};
+    std::atomic<uint64_t> writesQueued{0};
+    std::atomic<uint64_t> writesFailed{0};
+    std::atomic<uint64_t> writesTimedOut{0};
+
+public:
+    explicit TaskRuntime(size_t workerCount) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+        for (size_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(&TaskRuntime::workerLoop, this);
+        }
+        timerThread = std::thread(&TaskRuntime::timerLoop, this);
+        ioThread = std::thread(&TaskRuntime::ioLoop, this);
+        diskThread = std::thread(&TaskRuntime::diskLoop, this);
+    }
+
+    ~TaskRuntime() { stop(); }
+
+    TaskRuntime(const TaskRuntime&) = delete;
+    TaskRuntime& operator=(const TaskRuntime&) = delete;
+
+    // Joins all threads. Suspended tasks are abandoned.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        readyChanged.notify_all();
+        {
+            // The timer thread checks stopping under timerMutex, so it is
+            // either about to see it or already waiting for this notify
+            std::lock_guard<std::mutex> lock(timerMutex);
+        }
+        timerChanged.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(diskMutex);
+        }
+        diskChanged.notify_all();
+        uint64_t one = 1;
+        if (::write(wakeFd, &one, sizeof(one)) < 0) {
+            // epoll_wait would block forever without the wakeup
+            ioThread.detach();
+        }
+
+        for (auto& worker : workers) worker.join();
+        timerThread.join();
+        diskThread.join();
+        if (ioThread.joinable()) ioThread.join();
+        close(epollFd);
+        close(wakeFd);
+    }
+
+    size_t workerCount() const { return workers.size(); }
+
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.push_back(std::move(fn));
+        }
+        readyChanged.notify_one();
+    }
+
+    void post(std::coroutine_handle<> handle) {
+        post([handle] { handle.resume(); });
+    }
+
+    // fn is posted to the pool after delay unless cancelTimer comes first
+    uint64_t after(Clock::duration delay, std::function<void()> fn) {
+        uint64_t id;
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(timerMutex);
+            id = nextTimer++;
+            Clock::time_point when = Clock::now() + delay;
+            // Timeouts mostly end before they fire; waking the timer thread
+            // for each one would cost more than the guarded work
+            earliest = when < timerWake;
+            timerQueue.emplace(when, id);
+            timers.emplace(id, std::make_pair(when, std::move(fn)));
+        }
+        if (earliest) timerChanged.notify_one();
+        return id;
+    }
+
+    bool cancelTimer(uint64_t id) {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        auto it = timers.find(id);
+        if (it == timers.end()) return false;
+        auto range = timerQueue.equal_range(it->second.first);
+        for (auto entry = range.first; entry != range.second; ++entry) {
+            if (entry->second == id) {
+                timerQueue.erase(entry);
+                break;
+            }
+        }
+        timers.erase(it);
+        return true;
+    }
+
+    // co_await runtime.resumeOnPool() continues the coroutine on a worker
+    auto resumeOnPool() {
+        struct Awaiter {
+            TaskRuntime& runtime;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { runtime.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    // co_await runtime.sleep(delay, token) is true after the full delay and
+    // false if the token was cancelled first
+    auto sleep(Clock::duration delay, CancelToken token) {
+        struct Awaiter {
+            TaskRuntime& runtime;
+            Clock::duration delay;
+            CancelToken token;
+            std::shared_ptr<Wake> wake;
+
+            bool await_ready() const { return token.cancelled(); }
+            void await_suspend(std::coroutine_handle<> handle) {
+                wake = std::make_shared<Wake>(&runtime);
+                wake->handle = handle;
+                std::lock_guard<std::mutex> lock(wake->idsMutex);
+                std::shared_ptr<Wake> shared = wake;
+                wake->timer = runtime.after(delay, [shared] { shared->trigger(true); });
+                wake->cancelCallback = token.onCancel([shared] { shared->trigger(false); });
+            }
+            bool await_resume() {
+                if (!wake) return false;
+                std::lock_guard<std::mutex> lock(wake->idsMutex);
+                runtime.cancelTimer(wake->timer);
+                token.removeCallback(wake->cancelCallback);
+                return wake->value;
+            }
+        };
+        return Awaiter{*this, delay, std::move(token), nullptr};
+    }
+
+    // co_await runtime.offload(fn) runs fn on the disk thread and continues
+    // on the pool with its result, so fsync and friends never hold a worker.
+    // Jobs run one at a time in the order they were offloaded.
+    template <typename F>
+    auto offload(F fn) {
+        using R = std::invoke_result_t<F&>;
+        struct Awaiter {
+            TaskRuntime& runtime;
+            F fn;
+            std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result{};
+            std::exception_ptr error;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                runtime.queueDisk([this, handle] {
+                    try {
+                        if constexpr (std::is_void_v<R>) {
+                            fn();
+                        } else {
+                            result.emplace(fn());
+                        }
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    runtime.post(handle);
+                });
+            }
+            R await_resume() {
+                if (error) std::rethrow_exception(error);
+                if constexpr (!std::is_void_v<R>) return std::move(*result);
+            }
+        };
+        return Awaiter{*this, std::move(fn)};
+    }
+
+    // Writes data in order after anything already queued on the channel.
+    // done, if set, gets true once every byte was handed to the kernel and
+    // false if the channel broke or the deadline passed. It runs on the
+    // thread that finished the write, so it must be short.
+    void write(const std::shared_ptr<Channel>& channel, std::shared_ptr<const std::string> data,
+               Clock::duration timeout, WriteCallback done = nullptr) {
+        int result = -1; // -1 queued, 0 failed, 1 written
+        {
+            std::lock_guard<std::mutex> lock(channel->channelMutex);
+            if (channel->broken) {
+                result = 0;
+            } else {
+                size_t offset = 0;
+                if (channel->queue.empty()) {
+                    ssize_t sent = send(channel->fd, data->data(), data->size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                    if (sent == static_cast<ssize_t>(data->size())) {
+                        result = 1;
+                    } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        result = 0;
+                    } else if (sent > 0) {
+                        offset = sent;
+                    }
+                }
+                if (result < 0) {
+                    std::weak_ptr<Channel> weak = channel;
+                    uint64_t sequence = channel->nextSequence++;
+                    uint64_t timer = after(timeout, [this, weak, sequence] { expire(weak, sequence); });
+                    channel->queue.push_back({std::move(data), offset, std::move(done), sequence, timer});
+                    arm(channel);
+                    writesQueued++;
+                    return;
+                }
+            }
+        }
+        if (result == 1) {
+            writesImmediate++;
+        } else {
+            writesFailed++;
+        }
+        if (done) done(result == 1);
+    }
+
+    // Stops all writes to the channel, failing queued ones, and shuts the
+    // socket down so its receive thread sees the disconnect
+    void shutdownChannel(const std::shared_ptr<Channel>& channel) {
+        std::vector<WriteCallback> failed;
+        {
+            std::lock_guard<std::mutex> lock(channel->channelMutex);
+            if (channel->broken) return;
+            breakLocked(*channel, failed);
+            shutdown(channel->fd, SHUT_RDWR);
+        }
+        for (auto& done : failed) done(false);
+    }
+
+    // Call before closing the socket; no write touches it afterwards, so a
+    // reused descriptor never receives another client's data
+    void closeChannel(const std::shared_ptr<Channel>& channel) {
+        std::vector<WriteCallback> failed;
+        {
+            std::lock_guard<std::mutex> lock(channel->channelMutex);
+            breakLocked(*channel, failed);
+            if (channel->registered) {
+                std::lock_guard<std::mutex> ioLock(ioMutex);
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, channel->fd, nullptr);
+                watched.erase(channel.get());
+                channel->registered = false;
+            }
+        }
+        for (auto& done : failed) done(false);
+    }
+
+    // Many writes in flight at once. co_await batch.wait(token) resumes
+    // when all of them finished or the token was cancelled; writes still
+    // pending then complete in the background.
+    class WriteBatch {
+        struct State {
+            std::mutex stateMutex;
+            size_t pending = 0;
+            std::vector<WriteResult> results;
+            std::shared_ptr<Wake> wake;
+        };
+        TaskRuntime& runtime;
+        std::shared_ptr<State> state = std::make_shared<State>();
+
+    public:
+        explicit WriteBatch(TaskRuntime& owner) : runtime(owner) {}
+
+        void add(const std::shared_ptr<Channel>& channel, std::shared_ptr<const std::string> data,
+                 Clock::duration timeout) {
+            size_t index;
+            {
+                std::lock_guard<std::mutex> lock(state->stateMutex);
+                index = state->results.size();
+                state->results.push_back({false, 0});
+                state->pending++;
+            }
+            std::shared_ptr<State> shared = state;
+            runtime.write(channel, std::move(data), timeout, [shared, index](bool ok) {
+                std::shared_ptr<Wake> wake;
+                {
+                    std::lock_guard<std::mutex> lock(shared->stateMutex);
+                    shared->results[index] = {ok, ok ? now() : 0};
+                    if (--shared->pending == 0) wake = shared->wake;
+                }
+                if (wake) wake->trigger(true);
+            });
+        }
+
+        auto wait(CancelToken token) {
+            struct Awaiter {
+                TaskRuntime& runtime;
+                std::shared_ptr<State> state;
+                CancelToken token;
+                std::shared_ptr<Wake> wake;
+
+                bool await_ready() {
+                    std::lock_guard<std::mutex> lock(state->stateMutex);
+                    return state->pending == 0;
+                }
+                bool await_suspend(std::coroutine_handle<> handle) {
+                    wake = std::make_shared<Wake>(&runtime);
+                    wake->handle = handle;
+                    std::lock_guard<std::mutex> idsLock(wake->idsMutex);
+                    {
+                        std::lock_guard<std::mutex> lock(state->stateMutex);
+                        if (state->pending == 0) {
+                            wake->fired = true;
+                            return false;
+                        }
+                        state->wake = wake;
+                    }
+                    std::shared_ptr<Wake> shared = wake;
+                    wake->cancelCallback = token.onCancel([shared] { shared->trigger(false); });
+                    return true;
+                }
+                std::vector<WriteResult> await_resume() {
+                    if (wake) {
+                        std::lock_guard<std::mutex> idsLock(wake->idsMutex);
+                        token.removeCallback(wake->cancelCallback);
+                    }
+                    std::lock_guard<std::mutex> lock(state->stateMutex);
+                    state->wake.reset();
+                    return state->results;
+                }
+            };
+            return Awaiter{runtime, state, std::move(token), nullptr};
+        }
+    };
+
+    // Runs body under a fresh token and lists it in status() until it
+    // finishes. body starts on the calling thread and continues on the pool
+    // once it first suspends, so a fan-out whose writes all go out at once
+    // never changes threads; co_await resumeOnPool() first to leave the
+    // caller right away. A positive timeout cancels the token with reason
+    // "timeout". The future carries the result or the exception.
+    template <typename T>
+    std::future<T> spawn(const std::string& name, std::function<Task<T>(CancelToken)> body,
+                         Clock::duration timeout = Clock::duration::zero()) {
+        auto result = std::make_shared<std::promise<T>>();
+        std::future<T> future = result->get_future();
+        CancelToken token;
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            id = nextTask++;
+            running.emplace(id, RunningTask{name, Clock::now(), token});
+        }
+        tasksSpawned++;
+        uint64_t timer = 0;
+        if (timeout > Clock::duration::zero()) {
+            timer = after(timeout, [token]() mutable { token.cancel("timeout"); });
+        }
+        launch<T>(std::move(body), token, result, id, timer);
+        return future;
+    }
+
+    bool cancel(uint64_t id) {
+        CancelToken token;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            auto it = running.find(id);
+            if (it == running.end()) return false;
+            token = it->second.token;
+        }
+        token.cancel("cancelled");
+        return true;
+    }
+
+    std::string status() {
+        auto current = Clock::now();
+        std::ostringstream oss;
+        oss << "{\"workers\": " << workers.size() << ", \"tasks\": [";
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            bool first = true;
+            for (const auto& entry : running) {
+                if (!first) oss << ",";
+                first = false;
+                oss << "{\"id\": " << entry.first << ", \"name\": \"" << entry.second.name << "\", \"running_ms\": "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(current - entry.second.started).count()
+                    << ", \"cancelled\": " << (entry.second.token.cancelled() ? "true" : "false") << "}";
+            }
+        }
+        size_t waiting;
+        {
+            std::lock_guard<std::mutex> lock(ioMutex);
+            waiting = watched.size();
+        }
+        oss << "], \"spawned\": " << tasksSpawned << ", \"completed\": " << tasksCompleted
+            << ", \"cancelled\": " << tasksCancelled << ", \"timed_out\": " << tasksTimedOut
+            << ", \"writes_immediate\": " << writesImmediate << ", \"writes_queued\": " << writesQueued
+            << ", \"writes_failed\": " << writesFailed << ", \"write_timeouts\": " << writesTimedOut
+            << ", \"channels_waiting\": " << waiting << "}";
+        return oss.str();
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+private:
+    template <typename T>
+    Detached launch(std::function<Task<T>(CancelToken)> body, CancelToken token,
+                    std::shared_ptr<std::promise<T>> result, uint64_t id, uint64_t timer) {
+        std::exception_ptr error;
+        if constexpr (std::is_void_v<T>) {
+            try {
+                co_await body(token);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            finished(id, timer, token);
+            if (error) {
+                result->set_exception(error);
+            } else {
+                result->set_value();
+            }
+        } else {
+            std::optional<T> value;
+            try {
+                value.emplace(co_await body(token));
+            } catch (...) {
+                error = std::current_exception();
+            }
+            finished(id, timer, token);
+            if (error) {
+                result->set_exception(error);
+            } else {
+                result->set_value(std::move(*value));
+            }
+        }
+    }
+
+    void finished(uint64_t id, uint64_t timer, const CancelToken& token) {
+        if (timer) cancelTimer(timer);
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            running.erase(id);
+        }
+        if (!token.cancelled()) {
+            tasksCompleted++;
+        } else if (token.reason() == "timeout") {
+            tasksTimedOut++;
+        } else {
+            tasksCancelled++;
+        }
+    }
+
+    // Caller holds channelMutex
+    void arm(const std::shared_ptr<Channel>& channel) {
+        epoll_event event{};
+        event.events = EPOLLOUT | EPOLLONESHOT;
+        event.data.ptr = channel.get();
+        if (!channel->registered) {
+            std::lock_guard<std::mutex> lock(ioMutex);
+            watched[channel.get()] = channel;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, channel->fd, &event);
+            channel->registered = true;
+        } else {
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, channel->fd, &event);
+        }
+    }
+
+    // Caller holds channelMutex
+    void breakLocked(Channel& channel, std::vector<WriteCallback>& failed) {
+        channel.broken = true;
+        for (auto& pending : channel.queue) {
+            cancelTimer(pending.timer);
+            if (pending.done) failed.push_back(std::move(pending.done));
+            writesFailed++;
+        }
+        channel.queue.clear();
+    }
+
+    // Socket became writable: send as much of the queue as it takes
+    void flush(const std::shared_ptr<Channel>& channel) {
+        std::vector<WriteCallback> written;
+        std::vector<WriteCallback> failed;
+        {
+            std::lock_guard<std::mutex> lock(channel->channelMutex);
+            if (channel->broken) return;
+            while (!channel->queue.empty()) {
+                Channel::Pending& pending = channel->queue.front();
+                ssize_t sent = send(channel->fd, pending.data->data() + pending.offset,
+                                    pending.data->size() - pending.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                        arm(channel);
+                    } else {
+                        breakLocked(*channel, failed);
+                    }
+                    break;
+                }
+                pending.offset += sent;
+                if (pending.offset < pending.data->size()) continue;
+                cancelTimer(pending.timer);
+                if (pending.done) written.push_back(std::move(pending.done));
+                channel->queue.pop_front();
+            }
+        }
+        for (auto& done : written) done(true);
+        for (auto& done : failed) done(false);
+    }
+
+    // A queued write missed its deadline; the client is not reading
+    void expire(const std::weak_ptr<Channel>& weak, uint64_t sequence) {
+        std::shared_ptr<Channel> channel = weak.lock();
+        if (!channel) return;
+        std::vector<WriteCallback> failed;
+        {
+            std::lock_guard<std::mutex> lock(channel->channelMutex);
+            bool queued = false;
+            for (const auto& pending : channel->queue) {
+                if (pending.sequence == sequence) queued = true;
+            }
+            if (!queued || channel->broken) return;
+            writesTimedOut++;
+            breakLocked(*channel, failed);
+            shutdown(channel->fd, SHUT_RDWR);
+        }
+        for (auto& done : failed) done(false);
+    }
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyChanged.wait(lock, [this] { return stopping || !ready.empty(); });
+                if (stopping) return;
+                job = std::move(ready.front());
+                ready.pop_front();
+            }
+            job();
+        }
+    }
+
+    void queueDisk(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(diskMutex);
+            diskJobs.push_back(std::move(job));
+        }
+        diskChanged.notify_one();
+    }
+
+    // Jobs still queued at stop() are abandoned with their tasks
+    void diskLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(diskMutex);
+                diskChanged.wait(lock, [this] { return stopping || !diskJobs.empty(); });
+                if (stopping) return;
+                job = std::move(diskJobs.front());
+                diskJobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void timerLoop() {
+        std::unique_lock<std::mutex> lock(timerMutex);
+        while (true) {
+            if (stopping) return;
+            Clock::time_point current = Clock::now();
+            auto next = timerQueue.begin();
+            if (next == timerQueue.end() || next->first > current) {
+                timerWake = current + std::chrono::seconds(1);
+                if (next != timerQueue.end()) timerWake = std::min(timerWake, next->first);
+                timerChanged.wait_until(lock, timerWake);
+                continue;
+            }
+            uint64_t id = next->second;
+            timerQueue.erase(next);
+            auto timer = timers.find(id);
+            std::function<void()> fn = std::move(timer->second.second);
+            timers.erase(timer);
+            post(std::move(fn));
+        }
+    }
+
+    void ioLoop() {
+        epoll_event events[64];
+        while (true) {
+            int count = epoll_wait(epollFd, events, 64, -1);
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.ptr == nullptr) return; // stop()
+                std::shared_ptr<Channel> channel;
+                {
+                    std::lock_guard<std::mutex> lock(ioMutex);
+                    auto it = watched.find(static_cast<Channel*>(events[i].data.ptr));
+                    if (it == watched.end()) continue;
+                    channel = it->second;
+                }
+                flush(channel);
+            }
+        }
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <ctime>
+#include <cstdint>
+#include <cctype>
+
+// Named publish/subscribe channels. Each topic keeps its subscribers as a
+// socket -> ip map, and each socket keeps the topics it joined, so publish
+// touches only the subscribers and a disconnect only the client's own
+// topics. Subscriptions belong to a connection; clients re-announce theirs
+// in the CLIENT_CONNECTED handshake after a reconnect.
+class TopicRegistry {
+public:
+    static const size_t MAX_TOPICS = 1024;
+    static const size_t MAX_TOPICS_PER_CLIENT = 64;
+
+    struct Subscriber {
+        int socket;
+        std::string ip;
+    };
+
+    struct Stats {
+        std::string name;
+        size_t subscribers;
+        uint64_t published;
+        uint64_t delivered;
+        uint64_t failed;
+        time_t lastPublished;
+    };
+
+private:
+    struct Topic {
+        std::unordered_map<int, std::string> subscribers;
+        uint64_t published = 0;
+        uint64_t delivered = 0;
+        uint64_t failed = 0;
+        time_t lastPublished = 0;
+    };
+
+    std::map<std::string, Topic> topics;
+    std::unordered_map<int, std::set<std::string>> bySocket;
+    std::mutex topicsMutex;
+
+public:
+    // Topic names go into frames and JSON unescaped
+    static bool validName(const std::string& name) {
+        if (name.empty() || name.size() > 64) return false;
+        return std::all_of(name.begin(), name.end(),
+            [](char c) { return isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.'; });
+    }
+
+    // Returns false if the name is invalid or a limit is reached
+    bool subscribe(int socket, const std::string& ip, const std::string& name) {
+        if (!validName(name)) return false;
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        if (!topics.count(name) && topics.size() >= MAX_TOPICS) return false;
+        std::set<std::string>& joined = bySocket[socket];
+        if (!joined.count(name) && joined.size() >= MAX_TOPICS_PER_CLIENT) return false;
+        joined.insert(name);
+        topics[name].subscribers[socket] = ip;
+        return true;
+    }
+
+    bool unsubscribe(int socket, const std::string& name) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        auto joined = bySocket.find(socket);
+        if (joined == bySocket.end() || !joined->second.erase(name)) return false;
+        if (joined->second.empty()) bySocket.erase(joined);
+        leave(socket, name);
+        return true;
+    }
+
+    // Drops every subscription of a closed connection. Call before the
+    // socket is closed so a reused descriptor never inherits them.
+    void clientGone(int socket) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        auto joined = bySocket.find(socket);
+        if (joined == bySocket.end()) return;
+        for (const auto& name : joined->second) {
+            leave(socket, name);
+        }
+        bySocket.erase(joined);
+    }
+
+    // Subscribers to send one publish to; counts the publish
+    std::vector<Subscriber> beginPublish(const std::string& name) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        std::vector<Subscriber> result;
+        auto it = topics.find(name);
+        if (it == topics.end()) return result;
+
+        Topic& topic = it->second;
+        topic.published++;
+        topic.lastPublished = time(nullptr);
+        result.reserve(topic.subscribers.size());
+        for (const auto& subscriber : topic.subscribers) {
+            result.push_back({subscriber.first, subscriber.second});
+        }
+        return result;
+    }
+
+    void finishPublish(const std::string& name, uint64_t delivered, uint64_t failed) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        auto it = topics.find(name);
+        if (it == topics.end()) return;
+        it->second.delivered += delivered;
+        it->second.failed += failed;
+    }
+
+    std::vector<Stats> stats() {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        std::vector<Stats> result;
+        for (const auto& entry : topics) {
+            const Topic& topic = entry.second;
+            result.push_back({entry.first, topic.subscribers.size(), topic.published,
+                topic.delivered, topic.failed, topic.lastPublished});
+        }
+        return result;
+    }
+
+    // Subscribers without counting a publish, for targeting other requests
+    std::vector<Subscriber> subscribers(const std::string& name) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        std::vector<Subscriber> result;
+        auto it = topics.find(name);
+        if (it == topics.end()) return result;
+        for (const auto& subscriber : it->second.subscribers) {
+            result.push_back({subscriber.first, subscriber.second});
+        }
+        return result;
+    }
+
+    std::vector<std::string> subscriberIps(const std::string& name) {
+        std::lock_guard<std::mutex> lock(topicsMutex);
+        std::vector<std::string> result;
+        auto it = topics.find(name);
+        if (it == topics.end()) return result;
+        for (const auto& subscriber : it->second.subscribers) {
+            result.push_back(subscriber.second);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+private:
+    // Caller holds topicsMutex. Topics stay around after their last
+    // subscriber leaves so their counters survive reconnects.
+    void leave(int socket, const std::string& name) {
+        auto it = topics.find(name);
+        if (it != topics.end()) it->second.subscribers.erase(socket);
+    }
+};
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+
+// Latency traces for sampled bridge commands. The Java bridge picks which
+// requests to sample and prefixes the command with its own timestamps
+// ("@trace=<id>,<http_receive>,<bridge_enqueue>,<bridge_send> <command>").
+// The C++ side adds its stages while the command runs and keeps finished
+// traces in a ring buffer. The bridge reports its remaining stages later
+// with "trace_report". All timestamps are CLOCK_MONOTONIC nanoseconds (Java
+// System.nanoTime() and std::chrono::steady_clock on Linux), so stages from
+// both processes line up as long as they run on the same host.
+class TraceRecorder {
+public:
+    static const size_t CAPACITY = 256;
+    static const size_t MAX_STAGES = 512;
+
+    struct Stage {
+        std::string name;
+        int64_t ns;
+        std::string detail;
+    };
+
+    struct Trace {
+        uint64_t sequence = 0;
+        std::string id;
+        std::string command;
+        std::vector<Stage> stages;
+        uint32_t droppedStages = 0;
+    };
+
+private:
+    std::vector<Trace> ring;
+    uint64_t nextSequence = 1;
+    std::mutex traceMutex;
+
+    // Trace being built by the current thread, if the command is sampled
+    static Trace*& current() {
+        static thread_local Trace* trace = nullptr;
+        return trace;
+    }
+
+public:
+    TraceRecorder() : ring(CAPACITY) {}
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Cheap enough for hot paths: one thread_local load when not sampled
+    static bool active() { return current() != nullptr; }
+
+    static void mark(const char* name) {
+        Trace* trace = current();
+        if (trace) addStage(*trace, name, now(), "");
+    }
+
+    static void mark(const char* name, const std::string& detail) {
+        Trace* trace = current();
+        if (trace) addStage(*trace, name, now(), detail);
+    }
+
+    // For stages timed elsewhere, e.g. writes finished on another thread
+    static void markAt(const char* name, int64_t ns, const std::string& detail) {
+        Trace* trace = current();
+        if (trace) addStage(*trace, name, ns, detail);
+    }
+
+    // Makes trace the current thread's trace until the scope ends
+    class Scope {
+        Trace* previous;
+    public:
+        explicit Scope(Trace* trace) : previous(current()) { current() = trace; }
+        ~Scope() { current() = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Strips an "@trace=..." prefix from command into trace. Returns false
+    // (leaving command untouched) if there is none or it is malformed.
+    static bool parsePrefix(std::string& command, Trace& trace) {
+        if (command.compare(0, 7, "@trace=") != 0) return false;
+        size_t space = command.find(' ');
+        std::string header = command.substr(7, space == std::string::npos ? std::string::npos : space - 7);
+
+        std::vector<std::string> fields;
+        std::istringstream iss(header);
+        std::string field;
+        while (std::getline(iss, field, ',')) fields.push_back(field);
+        if (fields.size() != 4 || !isName(fields[0])) return false;
+
+        static const char* javaStages[] = {"http_receive", "bridge_enqueue", "bridge_send"};
+        trace.id = fields[0];
+        for (int i = 0; i < 3; i++) {
+            addStage(trace, javaStages[i], strtoll(fields[i + 1].c_str(), nullptr, 10), "");
+        }
+
+        command = space == std::string::npos ? "" : command.substr(space + 1);
+        trace.command = command.substr(0, command.find(' '));
+        if (!isName(trace.command)) trace.command = "unknown";
+        return true;
+    }
+
+    void commit(Trace trace) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        trace.sequence = nextSequence++;
+        ring[trace.sequence % CAPACITY] = std::move(trace);
+    }
+
+    // Adds "name=ns" stages reported after the fact by the bridge
+    bool report(const std::string& id, std::istringstream& stages) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        Trace* trace = find(id);
+        if (!trace) return false;
+
+        std::string item;
+        while (stages >> item) {
+            size_t equals = item.find('=');
+            if (equals == std::string::npos || !isName(item.substr(0, equals))) continue;
+            addStage(*trace, item.substr(0, equals).c_str(), strtoll(item.c_str() + equals + 1, nullptr, 10), "");
+        }
+        std::stable_sort(trace->stages.begin(), trace->stages.end(),
+            [](const Stage& a, const Stage& b) { return a.ns < b.ns; });
+        return true;
+    }
+
+    // Most recent traces first, with total time and the slowest stage
+    std::string summaryJson() {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        std::ostringstream oss;
+        oss << "{\"traces\": [";
+        bool first = true;
+        for (const Trace* trace : newestFirst()) {
+            const Stage* slowest = nullptr;
+            int64_t slowestDelta = -1;
+            for (size_t i = 1; i < trace->stages.size(); i++) {
+                int64_t delta = trace->stages[i].ns - trace->stages[i - 1].ns;
+                if (delta > slowestDelta) {
+                    slowestDelta = delta;
+                    slowest = &trace->stages[i];
+                }
+            }
+            if (!first) oss << ",";
+            oss << "{\"id\": \"" << trace->id << "\", \"command\": \"" << trace->command
+                << "\", \"total_us\": " << totalMicros(*trace)
+                << ", \"slowest_stage\": \"" << (slowest ? slowest->name : "") << "\""
+                << ", \"slowest_us\": " << (slowestDelta < 0 ? 0 : slowestDelta / 1000) << "}";
+            first = false;
+        }
+        oss << "]}";
+        return oss.str();
+    }
+
+    // Every stage of one trace, as offset from the first stage and delta
+    // from the previous one. Empty if no trace has that id.
+    std::string detailJson(const std::string& id) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        Trace* trace = find(id);
+        if (!trace) return "";
+
+        std::ostringstream oss;
+        oss << "{\"id\": \"" << trace->id << "\", \"command\": \"" << trace->command
+            << "\", \"total_us\": " << totalMicros(*trace)
+            << ", \"dropped_stages\": " << trace->droppedStages << ", \"stages\": [";
+        for (size_t i = 0; i < trace->stages.size(); i++) {
+            const Stage& stage = trace->stages[i];
+            if (i > 0) oss << ",";
+            oss << "{\"stage\": \"" << stage.name << "\", \"at_us\": " << (stage.ns - trace->stages[0].ns) / 1000
+                << ", \"delta_us\": " << (i > 0 ? (stage.ns - trace->stages[i - 1].ns) / 1000 : 0);
+            if (!stage.detail.empty()) oss << ", \"detail\": \"" << stage.detail << "\"";
+            oss << "}";
+        }
+        oss << "]}";
+        return oss.str();
+    }
+
+    // Chrome trace event format (chrome://tracing, Perfetto). Each trace is
+    // one row; every stage is drawn as a slice from the previous stage, and
+    // per-client writes are instant events.
+    std::string chromeJson(const std::string& id) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        std::ostringstream oss;
+        oss << std::fixed;
+        oss.precision(3);
+        oss << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        for (const Trace* trace : newestFirst()) {
+            if (!id.empty() && trace->id != id) continue;
+
+            const Stage* previous = nullptr;
+            for (const Stage& stage : trace->stages) {
+                if (!first) oss << ",";
+                first = false;
+                if (stage.name == "client_write") {
+                    oss << "{\"name\": \"client_write\", \"ph\": \"i\", \"s\": \"t\", \"ts\": " << stage.ns / 1000.0
+                        << ", \"pid\": 1, \"tid\": " << trace->sequence
+                        << ", \"args\": {\"ip\": \"" << stage.detail << "\"}}";
+                    continue;
+                }
+                int64_t start = previous ? previous->ns : stage.ns;
+                oss << "{\"name\": \"" << stage.name << "\", \"cat\": \"" << trace->command
+                    << "\", \"ph\": \"X\", \"ts\": " << start / 1000.0 << ", \"dur\": " << (stage.ns - start) / 1000.0
+                    << ", \"pid\": 1, \"tid\": " << trace->sequence
+                    << ", \"args\": {\"trace_id\": \"" << trace->id << "\"}}";
+                previous = &stage;
+            }
+        }
+        oss << "]}";
+        return oss.str();
+    }
+
+    static void addStage(Trace& trace, const char* name, int64_t ns, const std::string& detail = "") {
+        if (trace.stages.size() >= MAX_STAGES) {
+            trace.droppedStages++;
+            return;
+        }
+        trace.stages.push_back({name, ns, detail});
+    }
+
+private:
+    // Ids and stage names end up in JSON unescaped, so keep them simple
+    static bool isName(const std::string& text) {
+        if (text.empty() || text.size() > 64) return false;
+        return std::all_of(text.begin(), text.end(),
+            [](char c) { return isalnum((unsigned char)c) || c == '-' || c == '_'; });
+    }
+
+    static int64_t totalMicros(const Trace& trace) {
+        if (trace.stages.size() < 2) return 0;
+        return (trace.stages.back().ns - trace.stages.front().ns) / 1000;
+    }
+
+    // Caller holds traceMutex
+    Trace* find(const std::string& id) {
+        for (Trace& trace : ring) {
+            if (trace.sequence != 0 && trace.id == id) return &trace;
+        }
+        return nullptr;
+    }
+
+    // Caller holds traceMutex
+    std::vector<const Trace*> newestFirst() {
+        std::vector<const Trace*> result;
+        for (uint64_t sequence = nextSequence - 1; sequence > 0 && nextSequence - sequence <= CAPACITY; sequence--) {
+            result.push_back(&ring[sequence % CAPACITY]);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include <sys/stat.h>
+
+// Optional journal of the workload the server sees: client connects,
+// every received client frame, disconnects and bridge commands, with their
+// arrival time. replay.cpp re-issues a journal against another build.
+// Journals are written only inside the capture directory.
+//
+// File layout: the 8-byte magic "SGCAP\0\0\1", then records of
+//
+//   type (1 byte) | connection (varint) | microseconds since the previous
+//   record (varint) | payload length (varint) | payload
+//
+// Varints are unsigned LEB128. Connections are numbered from 1 in order of
+// first appearance; the payload of ClientConnect is the client's IP.
+// When capture is off every hook costs one relaxed atomic load.
+class TrafficCapture {
+public:
+    enum Type : uint8_t {
+        ClientConnect = 1,
+        ClientFrame = 2,
+        ClientDisconnect = 3,
+        BridgeCommand = 4,
+        BridgeDisconnect = 5,
+    };
+
+    static constexpr char MAGIC[8] = {'S', 'G', 'C', 'A', 'P', 0, 0, 1};
+    static const uint64_t MAX_BYTES = 512ull * 1024 * 1024;
+
+    struct Record {
+        Type type;
+        uint32_t connection;
+        uint64_t micros; // since the start of the capture
+        std::string payload;
+    };
+
+private:
+    std::atomic<bool> enabled{false};
+    std::mutex captureMutex;
+    FILE* file = nullptr;
+    std::string directory;
+    std::string path;
+    std::chrono::steady_clock::time_point started;
+    int64_t lastMicros = 0;
+    uint64_t bytes = 0;
+    uint64_t records = 0;
+    uint32_t nextConnection = 1;
+    std::unordered_map<int, uint32_t> connections; // socket -> connection number
+    std::vector<char> scratch;
+
+public:
+    explicit TrafficCapture(const std::string& dir) : directory(dir) {}
+    ~TrafficCapture() { stop(); }
+
+    bool active() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Plain file names only, so a capture cannot overwrite server state
+    static bool validName(const std::string& name) {
+        return !name.empty() && name[0] != '.' && name.find_first_of("/\\\"\n") == std::string::npos
+            && name.find("..") == std::string::npos;
+    }
+
+    // Begins a journal at <directory>/<name>. Clients that are already
+    // connected (socket, ip) get their connect record first so replay can
+    // open their connections. The caller keeps the client list locked until
+    // this returns, so no connect hook is missed or doubled.
+    bool start(const std::string& name, const std::vector<std::pair<int, std::string>>& connected) {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        if (file || !validName(name)) return false;
+        mkdir(directory.c_str(), 0755);
+        std::string target = directory + "/" + name;
+        file = fopen(target.c_str(), "wb");
+        if (!file) return false;
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        fwrite(MAGIC, 1, sizeof(MAGIC), file);
+
+        path = target;
+        started = std::chrono::steady_clock::now();
+        lastMicros = 0;
+        bytes = sizeof(MAGIC);
+        records = 0;
+        nextConnection = 1;
+        connections.clear();
+        for (const auto& client : connected) {
+            append(ClientConnect, client.first, client.second.data(), client.second.size(), true);
+        }
+        enabled = true;
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        enabled = false;
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    // Hooks. socket identifies the connection only while it is open.
+    void clientConnected(int socket, const std::string& ip) {
+        if (active()) write(ClientConnect, socket, ip.data(), ip.size(), true);
+    }
+    void clientFrame(int socket, const char* data, size_t length) {
+        if (active()) write(ClientFrame, socket, data, length, false);
+    }
+    void clientDisconnected(int socket) {
+        if (active()) write(ClientDisconnect, socket, nullptr, 0, false);
+    }
+    void bridgeCommand(int socket, const std::string& command) {
+        if (active()) write(BridgeCommand, socket, command.data(), command.size(), false);
+    }
+    void bridgeDisconnected(int socket) {
+        if (active()) write(BridgeDisconnect, socket, nullptr, 0, false);
+    }
+
+    std::string status() {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        return std::string("{\"capturing\": ") + (file ? "true" : "false") + ", \"file\": \"" + path
+            + "\", \"records\": " + std::to_string(records) + ", \"bytes\": " + std::to_string(bytes) + "}";
+    }
+
+    // Reads a whole journal for replay. Returns false on a bad header or a
+    // truncated record (records before it are kept).
+    static bool read(const std::string& source, std::vector<Record>& out) {
+        FILE* in = fopen(source.c_str(), "rb");
+        if (!in) return false;
+        char magic[sizeof(MAGIC)];
+        bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+
+        uint64_t micros = 0;
+        int type;
+        while (ok && (type = fgetc(in)) != EOF) {
+            uint64_t connection, delta, length;
+            if (!readVarint(in, connection) || !readVarint(in, delta) || !readVarint(in, length)) {
+                ok = false;
+                break;
+            }
+            if (length > 64 * 1024 * 1024) {
+                ok = false;
+                break;
+            }
+            micros += delta;
+            Record record{static_cast<Type>(type), static_cast<uint32_t>(connection), micros, std::string(length, '\0')};
+            if (length > 0 && fread(&record.payload[0], 1, length, in) != length) {
+                ok = false;
+                break;
+            }
+            out.push_back(std::move(record));
+        }
+        fclose(in);
+        return ok;
+    }
+
+private:
+    void write(Type type, int socket, const char* data, size_t length, bool opens) {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        append(type, socket, data, length, opens);
+    }
+
+    // Caller holds captureMutex
+    void append(Type type, int socket, const char* data, size_t length, bool opens) {
+        if (!file) return;
+
+        uint32_t connection;
+        auto it = connections.find(socket);
+        if (it == connections.end() || opens) {
+            connection = nextConnection++;
+            connections[socket] = connection;
+        } else {
+            connection = it->second;
+        }
+        if (type == ClientDisconnect || type == BridgeDisconnect) {
+            connections.erase(socket);
+        }
+
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        int64_t delta = now > lastMicros ? now - lastMicros : 0;
+        lastMicros += delta;
+
+        scratch.clear();
+        scratch.push_back(static_cast<char>(type));
+        appendVarint(connection);
+        appendVarint(delta);
+        appendVarint(length);
+        scratch.insert(scratch.end(), data, data + length);
+        fwrite(scratch.data(), 1, scratch.size(), file);
+        bytes += scratch.size();
+        records++;
+
+        if (bytes >= MAX_BYTES) {
+            enabled = false;
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void appendVarint(uint64_t value) {
+        while (value >= 0x80) {
+            scratch.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        scratch.push_back(static_cast<char>(value));
+    }
+
+    static bool readVarint(FILE* in, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = fgetc(in);
+            if (byte == EOF) return false;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Receives files from clients over their normal connection. Frames are text
+// headers terminated by '\n'; chunk payloads follow their header as raw bytes
+// and are moved socket -> pipe -> file with splice() so they never pass
+// through user space. Partial files are kept as <dir>/<ip>-<name>.part so a
+// transfer interrupted by a disconnect or restart resumes at the part size.
+//
+//   server: UPLOAD_REQUEST:<id>:<offset>:<name>
+//   client: UPLOAD_BEGIN:<id>:<total>
+//   client: UPLOAD_CHUNK:<id>:<offset>:<length>  followed by <length> bytes
+//   server: UPLOAD_ACK:<id>:<offset>             (credit for the next chunk)
+//   client: UPLOAD_END:<id> | UPLOAD_ERROR:<id>:<reason>
+//   server: UPLOAD_ERROR:<id>:expired           (request timed out; stop sending)
+class UploadManager {
+public:
+    static const size_t MAX_CHUNK = 1024 * 1024;
+    static const size_t MAX_ACTIVE = 4;
+    static const size_t MAX_HEADER = 128;
+    static const time_t REQUEST_TIMEOUT = 60; // seconds to answer UPLOAD_REQUEST
+
+    using LogCallback = std::function<void(const std::string&)>;
+    // Writes one frame to the uploading client's connection; false if it
+    // could not be sent
+    using Sender = std::function<bool(const std::string&)>;
+
+private:
+    struct Upload {
+        uint64_t id;
+        int socket;
+        std::string ip;
+        std::string name;
+        std::string partPath;
+        Sender send;
+        int fd = -1;
+        int pipeFds[2] = {-1, -1};
+        uint64_t offset = 0;
+        uint64_t total = 0;
+        bool started = false;
+        time_t requested = 0;
+    };
+
+    std::map<uint64_t, std::shared_ptr<Upload>> uploads;
+    std::mutex uploadsMutex;
+    uint64_t nextId = 1;
+    std::string directory;
+    LogCallback log;
+
+public:
+    explicit UploadManager(const std::string& dir) : directory(dir) {}
+
+    void setLogger(LogCallback callback) { log = std::move(callback); }
+
+    // Asks the client on socket to send its file "name". Every frame for
+    // this upload goes out through send, never straight to the socket, so
+    // it cannot interleave with other writes to that client.
+    std::string request(int socket, const std::string& ip, const std::string& name, Sender send) {
+        if (name.empty() || name.find_first_of("/\\:\n") != std::string::npos || name[0] == '.') {
+            return "{\"error\": \"Invalid upload name\"}";
+        }
+
+        auto upload = std::make_shared<Upload>();
+        upload->socket = socket;
+        upload->ip = ip;
+        upload->name = name;
+        upload->send = std::move(send);
+        upload->partPath = directory + "/" + ip + "-" + name + ".part";
+        upload->requested = time(nullptr);
+
+        {
+            std::lock_guard<std::mutex> lock(uploadsMutex);
+            expireUnanswered(upload->requested);
+            if (uploads.size() >= MAX_ACTIVE) {
+                return "{\"error\": \"Upload limit reached (" + std::to_string(MAX_ACTIVE) + " active)\"}";
+            }
+            for (const auto& entry : uploads) {
+                if (entry.second->partPath == upload->partPath) {
+                    return "{\"error\": \"Upload of " + name + " from " + ip + " already in progress\"}";
+                }
+            }
+            upload->id = nextId++;
+            uploads[upload->id] = upload;
+        }
+
+        mkdir(directory.c_str(), 0755);
+        struct stat st;
+        if (stat(upload->partPath.c_str(), &st) == 0) {
+            upload->offset = st.st_size; // resume
+        }
+
+        std::string frame = "UPLOAD_REQUEST:" + std::to_string(upload->id) + ":"
+            + std::to_string(upload->offset) + ":" + name + "\n";
+        if (!upload->send(frame)) {
+            finish(upload, false);
+            return "{\"error\": \"Failed to send upload request to " + ip + "\"}";
+        }
+
+        logMessage("Requested upload " + std::to_string(upload->id) + " of " + name + " from " + ip
+            + (upload->offset ? " resuming at " + std::to_string(upload->offset) : ""));
+        return "{\"upload_id\": " + std::to_string(upload->id) + ", \"resume_offset\": "
+            + std::to_string(upload->offset) + "}";
+    }
+
+    // Consumes every complete UPLOAD_* frame at the front of data, reading any
+    // missing header or payload bytes straight from the socket. On return data
+    // holds whatever followed the frames. Frames for a request that expired
+    // are answered through reply and their payload is discarded. Returns
+    // false on a protocol error, in which case the connection should be
+    // dropped.
+    bool handleFrames(int socket, std::string& data, const Sender& reply) {
+        while (data.compare(0, 7, "UPLOAD_") == 0) {
+            size_t newline = data.find('\n');
+            while (newline == std::string::npos) {
+                if (data.size() > MAX_HEADER) return false;
+                char buffer[MAX_HEADER];
+                int received = recv(socket, buffer, sizeof(buffer), 0);
+                if (received <= 0) return false;
+                data.append(buffer, received);
+                newline = data.find('\n');
+            }
+
+            std::string header = data.substr(0, newline);
+            data.erase(0, newline + 1);
+
+            std::vector<std::string> fields;
+            std::istringstream iss(header);
+            std::string field;
+            while (std::getline(iss, field, ':')) fields.push_back(field);
+            if (fields.size() < 2) return false;
+
+            uint64_t id = strtoull(fields[1].c_str(), nullptr, 10);
+            std::shared_ptr<Upload> upload = find(id, socket);
+            if (!upload) {
+                if (!unknownUpload(socket, data, fields, reply)) return false;
+                continue;
+            }
+
+            if (fields[0] == "UPLOAD_BEGIN" && fields.size() == 3) {
+                if (!begin(upload, strtoull(fields[2].c_str(), nullptr, 10))) return false;
+            } else if (fields[0] == "UPLOAD_CHUNK" && fields.size() == 4) {
+                uint64_t offset = strtoull(fields[2].c_str(), nullptr, 10);
+                size_t length = strtoull(fields[3].c_str(), nullptr, 10);
+                if (!upload->started || offset != upload->offset || length == 0 || length > MAX_CHUNK
+                        || length > upload->total - upload->offset) {
+                    return false;
+                }
+                if (!receiveChunk(socket, upload, data, length)) {
+                    finish(upload, false);
+                    return false;
+                }
+                upload->send("UPLOAD_ACK:" + std::to_string(id) + ":" + std::to_string(upload->offset) + "\n");
+            } else if (fields[0] == "UPLOAD_END") {
+                finish(upload, upload->started && upload->offset == upload->total);
+            } else if (fields[0] == "UPLOAD_ERROR") {
+                logMessage("Upload " + std::to_string(id) + " refused by " + upload->ip + ": "
+                    + (fields.size() > 2 ? fields[2] : "unknown"));
+                finish(upload, false);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Releases transfers owned by a closed connection. Their part files stay
+    // on disk so the next request for the same name resumes.
+    void clientGone(int socket) {
+        std::vector<std::shared_ptr<Upload>> orphaned;
+        {
+            std::lock_guard<std::mutex> lock(uploadsMutex);
+            for (const auto& entry : uploads) {
+                if (entry.second->socket == socket) orphaned.push_back(entry.second);
+            }
+        }
+        for (auto& upload : orphaned) finish(upload, false);
+    }
+
+    std::string status() {
+        std::lock_guard<std::mutex> lock(uploadsMutex);
+        std::ostringstream oss;
+        oss << "{\"uploads\": [";
+        bool first = true;
+        for (const auto& entry : uploads) {
+            const Upload& upload = *entry.second;
+            if (!first) oss << ",";
+            oss << "{\"id\": " << upload.id << ", \"ip\": \"" << upload.ip << "\", \"name\": \"" << upload.name
+                << "\", \"received\": " << upload.offset << ", \"total\": " << upload.total
+                << ", \"started\": " << (upload.started ? "true" : "false") << "}";
+            first = false;
+        }
+        oss << "], \"active\": " << uploads.size() << ", \"limit\": " << MAX_ACTIVE << "}";
+        return oss.str();
+    }
+
+private:
+    void logMessage(const std::string& message) {
+        if (log) log(message);
+    }
+
+    // Requests the client never answered would hold a MAX_ACTIVE slot until
+    // it disconnects. Caller holds uploadsMutex; unstarted uploads own no
+    // descriptors, so dropping them from the map is enough.
+    void expireUnanswered(time_t now) {
+        for (auto it = uploads.begin(); it != uploads.end();) {
+            const Upload& upload = *it->second;
+            if (!upload.started && now - upload.requested >= REQUEST_TIMEOUT) {
+                logMessage("Upload " + std::to_string(upload.id) + " of " + upload.name + " from " + upload.ip
+                    + " expired without an answer");
+                it = uploads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // A client that answers after expireUnanswered dropped its request is
+    // told to stop. A chunk it already sent is read off the socket so the
+    // stream stays in sync.
+    bool unknownUpload(int socket, std::string& data, const std::vector<std::string>& fields, const Sender& reply) {
+        if (fields[0] == "UPLOAD_BEGIN") {
+            reply("UPLOAD_ERROR:" + fields[1] + ":expired\n");
+            return true;
+        }
+        if (fields[0] == "UPLOAD_CHUNK" && fields.size() == 4) {
+            size_t length = strtoull(fields[3].c_str(), nullptr, 10);
+            return length <= MAX_CHUNK && discard(socket, data, length);
+        }
+        return fields[0] == "UPLOAD_END" || fields[0] == "UPLOAD_ERROR";
+    }
+
+    static bool discard(int socket, std::string& data, size_t length) {
+        size_t buffered = std::min(length, data.size());
+        data.erase(0, buffered);
+        length -= buffered;
+        char buffer[16 * 1024];
+        while (length > 0) {
+            ssize_t received = recv(socket, buffer, std::min(length, sizeof(buffer)), 0);
+            if (received <= 0) return false;
+            length -= received;
+        }
+        return true;
+    }
+
+    std::shared_ptr<Upload> find(uint64_t id, int socket) {
+        std::lock_guard<std::mutex> lock(uploadsMutex);
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second->socket != socket) return nullptr;
+        return it->second;
+    }
+
+    bool begin(const std::shared_ptr<Upload>& upload, uint64_t total) {
+        if (upload->started) return false;
+        if (total < upload->offset) {
+            // Source shrank since the part was written; start over.
+            unlink(upload->partPath.c_str());
+            upload->offset = 0;
+        }
+
+        upload->fd = open(upload->partPath.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (upload->fd < 0 || ftruncate(upload->fd, upload->offset) < 0
+                || lseek(upload->fd, upload->offset, SEEK_SET) < 0) {
+            logMessage("Upload " + std::to_string(upload->id) + ": cannot open " + upload->partPath);
+            return false;
+        }
+        if (pipe(upload->pipeFds) < 0) {
+            upload->pipeFds[0] = upload->pipeFds[1] = -1; // fall back to read/write
+        }
+
+        upload->total = total;
+        upload->started = true;
+
+        // Tell the client where to start; it resends from the acked offset.
+        upload->send("UPLOAD_ACK:" + std::to_string(upload->id) + ":" + std::to_string(upload->offset) + "\n");
+        return true;
+    }
+
+    // Bytes that arrived in the same recv() as the header are written from
+    // the buffer; the rest of the payload is spliced from the socket.
+    bool receiveChunk(int socket, const std::shared_ptr<Upload>& upload, std::string& data, size_t length) {
+        size_t buffered = std::min(length, data.size());
+        if (buffered > 0) {
+            if (!writeAll(upload->fd, data.data(), buffered)) return false;
+            data.erase(0, buffered);
+        }
+
+        size_t remaining = length - buffered;
+        while (remaining > 0) {
+            ssize_t moved = upload->pipeFds[1] >= 0
+                ? spliceOnce(socket, upload->pipeFds, upload->fd, remaining)
+                : copyOnce(socket, upload->fd, remaining);
+            if (moved <= 0) return false;
+            remaining -= moved;
+        }
+
+        upload->offset += length;
+        return true;
+    }
+
+    static ssize_t spliceOnce(int socket, int pipeFds[2], int fd, size_t length) {
+        ssize_t in = splice(socket, nullptr, pipeFds[1], nullptr, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in <= 0) return in;
+        ssize_t left = in;
+        while (left > 0) {
+            ssize_t out = splice(pipeFds[0], nullptr, fd, nullptr, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (out <= 0) return -1;
+            left -= out;
+        }
+        return in;
+    }
+
+    static ssize_t copyOnce(int socket, int fd, size_t length) {
+        static thread_local std::vector<char> buffer(256 * 1024);
+        ssize_t in = recv(socket, buffer.data(), std::min(length, buffer.size()), 0);
+        if (in <= 0) return in;
+        return writeAll(fd, buffer.data(), in) ? in : -1;
+    }
+
+    static bool writeAll(int fd, const char* data, size_t length) {
+        while (length > 0) {
+            ssize_t written = write(fd, data, length);
+            if (written <= 0) return false;
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    // Completed uploads are renamed to <ip>-<name>-<timestamp>; failed ones
+    // leave their part file for a later resume.
+    void finish(const std::shared_ptr<Upload>& upload, bool complete) {
+        {
+            std::lock_guard<std::mutex> lock(uploadsMutex);
+            if (uploads.erase(upload->id) == 0) return;
+        }
+
+        if (upload->fd >= 0) close(upload->fd);
+        if (upload->pipeFds[0] >= 0) close(upload->pipeFds[0]);
+        if (upload->pipeFds[1] >= 0) close(upload->pipeFds[1]);
+        upload->fd = upload->pipeFds[0] = upload->pipeFds[1] = -1;
+
+        if (complete) {
+            std::string finalPath = directory + "/" + upload->ip + "-" + upload->name + "-" + std::to_string(time(nullptr));
+            rename(upload->partPath.c_str(), finalPath.c_str());
+            logMessage("Upload " + std::to_string(upload->id) + " complete: " + finalPath
+                + " (" + std::to_string(upload->total) + " bytes)");
+        } else if (upload->started) {
+            logMessage("Upload " + std::to_string(upload->id) + " from " + upload->ip + " paused at "
+                + std::to_string(upload->offset) + "/" + std::to_string(upload->total) + " bytes");
+        }
+    }
+};